@@ -0,0 +1,168 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#include "adc_dma.hpp"
+#include "esp_adc/adc_cali_scheme.h"
+#include "const.h"
+#include "log.h"
+
+#define ADC_DMA_ATTEN             ADC_ATTEN_DB_12       // same attenuation as used by Arduino's analogRead
+#define ADC_DMA_BITWIDTH          SOC_ADC_DIGI_MAX_BITWIDTH
+
+ADCSampler_DMA::~ADCSampler_DMA(){
+  if (_hndlr){
+    adc_continuous_deinit(_hndlr);
+    _hndlr = nullptr;
+  }
+
+  if (_cal_handle){
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_delete_scheme_curve_fitting(_cal_handle);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    adc_cali_delete_scheme_line_fitting(_cal_handle);
+#endif
+    _cal_handle = nullptr;
+  }
+}
+
+esp_err_t ADCSampler_DMA::init(int gpio, size_t samples, uint32_t freq){
+  if (_hndlr) return ESP_OK;
+
+  esp_err_t err = adc_continuous_io_to_channel(gpio, &_unit, &_chan);
+  if (err != ESP_OK){
+    LOGE(T_ADC, printf, "gpio %d is not ADC pin!\n", gpio);
+    return err;
+  }
+
+  _frame_size = samples * SOC_ADC_DIGI_RESULT_BYTES;
+  _buf = std::make_unique<uint8_t[]>(_frame_size);
+
+  adc_continuous_handle_cfg_t adc_config = {
+    .max_store_buf_size = static_cast<uint32_t>(_frame_size * 2),
+    .conv_frame_size = static_cast<uint32_t>(_frame_size),
+  };
+  err = adc_continuous_new_handle(&adc_config, &_hndlr);
+  if (err != ESP_OK) return err;
+
+  adc_digi_pattern_config_t pattern = {
+    .atten = ADC_DMA_ATTEN,
+    .channel = static_cast<uint8_t>(_chan),
+    .unit = static_cast<uint8_t>(_unit),
+    .bit_width = ADC_DMA_BITWIDTH
+  };
+
+  adc_continuous_config_t dig_cfg = {
+    .pattern_num = 1,
+    .adc_pattern = &pattern,
+    .sample_freq_hz = freq,
+    .conv_mode = _unit == ADC_UNIT_1 ? ADC_CONV_SINGLE_UNIT_1 : ADC_CONV_SINGLE_UNIT_2,
+    .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2
+  };
+  err = adc_continuous_config(_hndlr, &dig_cfg);
+  if (err != ESP_OK) return err;
+
+  adc_continuous_evt_cbs_t cbs = {
+    .on_conv_done = ADCSampler_DMA::_cb_conv_done
+  };
+  err = adc_continuous_register_event_callbacks(_hndlr, &cbs, this);
+  if (err != ESP_OK) return err;
+
+  if (_adc_calibration_init() != ESP_OK){
+    // fallback to ideal transfer function
+    _mv_k = (3100 << 16) / (1 << ADC_DMA_BITWIDTH);
+    _mv_off = 0;
+  }
+
+  ADC_LOGD(T_ADC, printf, "DMA sampler on gpio:%d, %u samples @ %u Hz\n", gpio, samples, freq);
+  return ESP_OK;
+}
+
+esp_err_t ADCSampler_DMA::_adc_calibration_init(){
+  esp_err_t ret = ESP_FAIL;
+
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+  adc_cali_curve_fitting_config_t cali_config = {
+      .unit_id = _unit,
+      .chan = _chan,
+      .atten = ADC_DMA_ATTEN,
+      .bitwidth = ADC_DMA_BITWIDTH,
+  };
+  ret = adc_cali_create_scheme_curve_fitting(&cali_config, &_cal_handle);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+  adc_cali_line_fitting_config_t cali_config = {
+      .unit_id = _unit,
+      .atten = ADC_DMA_ATTEN,
+      .bitwidth = ADC_DMA_BITWIDTH,
+  };
+  ret = adc_cali_create_scheme_line_fitting(&cali_config, &_cal_handle);
+#endif
+
+  if (ret != ESP_OK){
+    ADC_LOGD(T_ADC, println, "eFuse not burnt, skip software calibration");
+    return ret;
+  }
+
+  // calibration is (nearly) linear in the working range, so instead of converting each sample
+  // I take two reference points and convert samples with integer math
+  int raw_lo = (1 << ADC_DMA_BITWIDTH) / 4, raw_hi = (1 << ADC_DMA_BITWIDTH) * 3 / 4;
+  int mv_lo{0}, mv_hi{0};
+  adc_cali_raw_to_voltage(_cal_handle, raw_lo, &mv_lo);
+  adc_cali_raw_to_voltage(_cal_handle, raw_hi, &mv_hi);
+  _mv_k = ((mv_hi - mv_lo) << 16) / (raw_hi - raw_lo);
+  _mv_off = mv_lo - ((raw_lo * _mv_k) >> 16);
+  ADC_LOGD(T_ADC, printf, "ADC Calibration enabled, k:%d, off:%d\n", _mv_k, _mv_off);
+  return ESP_OK;
+}
+
+size_t ADCSampler_DMA::capture(uint32_t* mv, size_t n, TickType_t timeout){
+  if (!_hndlr || n * SOC_ADC_DIGI_RESULT_BYTES > _frame_size) return 0;
+
+  _task = xTaskGetCurrentTaskHandle();
+  // drop stale notification from a late frame of previous capture, if any
+  ulTaskNotifyTake(pdTRUE, 0);
+
+  if (adc_continuous_start(_hndlr) != ESP_OK) return 0;
+
+  // task notification is shared with other sources (i.e. heater's PWM sync timer), a late one from those
+  // must not end the capture, so it's only done when a frame could be read
+  uint32_t len{0};
+  TickType_t t0 = xTaskGetTickCount();
+  while (!len){
+    TickType_t spent = xTaskGetTickCount() - t0;
+    if (spent > timeout || !ulTaskNotifyTake(pdTRUE, timeout - spent)) break;
+    adc_continuous_read(_hndlr, _buf.get(), _frame_size, &len, 0);
+  }
+
+  adc_continuous_stop(_hndlr);
+  // discard frames converted after notification, so that next capture would start with fresh data
+  adc_continuous_flush_pool(_hndlr);
+
+  size_t cnt{0};
+  for (uint32_t i = 0; i < len && cnt < n; i += SOC_ADC_DIGI_RESULT_BYTES){
+    const adc_digi_output_data_t *p = reinterpret_cast<const adc_digi_output_data_t*>(&_buf[i]);
+    if (p->type2.channel != _chan) continue;
+    int32_t v = ((static_cast<int32_t>(p->type2.data) * _mv_k) >> 16) + _mv_off;
+    mv[cnt++] = v < 0 ? 0 : v;
+  }
+
+  if (cnt != n){
+    ADC_LOGD(T_ADC, printf, "DMA capture incomplete: %u/%u\n", cnt, n);
+  }
+  return cnt;
+}
+
+bool ADCSampler_DMA::_cb_conv_done(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data){
+  BaseType_t task_awoken{0};
+  TaskHandle_t t = static_cast<ADCSampler_DMA*>(user_data)->_task;
+  if (t)
+    vTaskNotifyGiveFromISR(t, &task_awoken);
+  return task_awoken;
+}
@@ -0,0 +1,71 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <memory>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali.h"
+
+/**
+ * @brief ADC sampler that uses continuous (DMA) mode
+ * a capture of a block of samples runs in background, calling task is blocked on notification
+ * until DMA buffer is filled, so no CPU time is spent on per-sample ADC calls
+ *
+ * @note continuous mode locks ADC unit for the capture time, oneshot reads on the same unit
+ * (i.e. analogRead on other pins) will fail if performed during a capture
+ */
+class ADCSampler_DMA {
+  adc_continuous_handle_t _hndlr{nullptr};
+  adc_cali_handle_t _cal_handle{nullptr};
+  adc_unit_t _unit;
+  adc_channel_t _chan;
+
+  // task to notify on capture completion
+  TaskHandle_t _task{nullptr};
+
+  // DMA conversion frame buffer
+  std::unique_ptr<uint8_t[]> _buf;
+  size_t _frame_size{0};
+
+  // linear raw->mV conversion, mV = (raw * _mv_k >> 16) + _mv_off
+  int32_t _mv_k{0}, _mv_off{0};
+
+  esp_err_t _adc_calibration_init();
+
+  static bool IRAM_ATTR _cb_conv_done(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data);
+
+public:
+  ~ADCSampler_DMA();
+
+  /**
+   * @brief initialize ADC in continuous mode
+   *
+   * @param gpio pin to sample
+   * @param samples number of samples in one capture
+   * @param freq sampling frequency, Hz
+   * @return esp_err_t
+   */
+  esp_err_t init(int gpio, size_t samples, uint32_t freq);
+
+  /**
+   * @brief capture a block of samples
+   * will start DMA conversion and block calling task until buffer is filled
+   * calling task's notification is used for completion, notifications from other sources are tolerated
+   *
+   * @param mv array to fill with calibrated samples in mV
+   * @param n number of samples to capture, must not exceed value given to init()
+   * @param timeout max time to wait for DMA buffer
+   * @return size_t number of samples captured, 0 on error
+   */
+  size_t capture(uint32_t* mv, size_t n, TickType_t timeout);
+};
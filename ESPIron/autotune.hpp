@@ -0,0 +1,169 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+#include <cmath>
+
+/**
+ * PID autotuning
+ * no Arduino/IDF dependencies, could be built for the host and run against thermalsim::TipPlant
+ */
+namespace autotune {
+
+struct Gains {
+  float kp, ki, kd;
+};
+
+/**
+ * @brief Åström–Hägglund relay feedback test
+ * heater output is switched between two levels around a setpoint, making tip temperature oscillate in a limit cycle.
+ * Ultimate gain and period are derived from oscillation amplitude and period, PID gains are calculated
+ * with Tyreus-Luyben rules which give less overshoot than Ziegler-Nichols for a thermal plant
+ */
+class RelayTuner {
+public:
+  enum class state_t {
+    idle = 0,
+    running,
+    done,
+    failed
+  };
+
+  struct Params {
+    float setpoint;               // temperature to oscillate around, C
+    float hysteresis{2};          // relay switching hysteresis, C
+    uint32_t out_high;            // relay output when temperature is below setpoint
+    uint32_t out_low{0};          // relay output when temperature is above setpoint
+    uint32_t cycles{4};           // number of oscillation periods to average
+    uint32_t timeout_ms{600000};  // max test duration, ms
+    float t_max;                  // abort test if temperature exceeds this, C
+  };
+
+private:
+  Params _p{};
+  state_t _state{state_t::idle};
+  bool _high{true};
+  uint32_t _start{0}, _last_switch{0};
+  // number of high->low relay switches
+  uint32_t _switches{0};
+  // temperature extremes in current half-cycle
+  float _peak_hi{0}, _peak_lo{0};
+  // accumulated extremes and periods
+  float _sum_hi{0}, _sum_lo{0};
+  uint32_t _sum_period{0}, _n_hi{0}, _n_lo{0}, _n_period{0};
+  // results
+  float _ku{0}, _pu{0};
+
+  // first two switches belong to heat-up transient and overshoot, those are not used for calculation
+  bool _steady() const { return _switches >= 2; }
+
+  void _finish(){
+    float a = (_sum_hi / _n_hi - _sum_lo / _n_lo) / 2;
+    if (a <= _p.hysteresis){
+      _state = state_t::failed;
+      return;
+    }
+    float d = (static_cast<float>(_p.out_high) - static_cast<float>(_p.out_low)) / 2;
+    // describing function of a relay with hysteresis
+    _ku = 4 * d / (static_cast<float>(M_PI) * std::sqrt(a * a - _p.hysteresis * _p.hysteresis));
+    _pu = static_cast<float>(_sum_period) / _n_period / 1000;
+    _state = state_t::done;
+  }
+
+public:
+  /**
+   * @brief start relay test
+   *
+   * @param p test parameters
+   * @param now current time, ms
+   */
+  void start(const Params& p, uint32_t now){
+    *this = RelayTuner();
+    _p = p;
+    _start = now;
+    _peak_lo = _p.setpoint;
+    _state = state_t::running;
+  }
+
+  // abort running test
+  void abort(){ if (_state == state_t::running) _state = state_t::failed; }
+
+  /**
+   * @brief feed a temperature measurement and get relay output
+   *
+   * @param now current time, ms
+   * @param t measured temperature, C
+   * @return uint32_t output to apply till next step, out_low if test is not running
+   */
+  uint32_t step(uint32_t now, float t){
+    if (_state != state_t::running) return _p.out_low;
+
+    if (t > _p.t_max || now - _start > _p.timeout_ms){
+      _state = state_t::failed;
+      return _p.out_low;
+    }
+
+    if (_high){
+      if (t < _peak_lo) _peak_lo = t;
+      if (t > _p.setpoint + _p.hysteresis){
+        _high = false;
+        if (_steady()){
+          _sum_lo += _peak_lo;
+          ++_n_lo;
+          _sum_period += now - _last_switch;
+          ++_n_period;
+        }
+        ++_switches;
+        _last_switch = now;
+        _peak_hi = t;
+        if (_n_period >= _p.cycles && _n_hi){
+          _finish();
+          return _p.out_low;
+        }
+      }
+    } else {
+      if (t > _peak_hi) _peak_hi = t;
+      if (t < _p.setpoint - _p.hysteresis){
+        _high = true;
+        if (_steady()){
+          _sum_hi += _peak_hi;
+          ++_n_hi;
+        }
+        _peak_lo = t;
+      }
+    }
+
+    return _high ? _p.out_high : _p.out_low;
+  }
+
+  state_t state() const { return _state; }
+
+  bool running() const { return _state == state_t::running; }
+
+  // ultimate gain, output units per C
+  float ultimateGain() const { return _ku; }
+
+  // ultimate period, seconds
+  float ultimatePeriod() const { return _pu; }
+
+  /**
+   * @brief PID gains by Tyreus-Luyben rules
+   * integral gain is per second and derivative gain is in seconds, same as pid::Controller expects
+   */
+  Gains gains() const {
+    float kp = _ku / 2.2f;
+    float ti = 2.2f * _pu, td = _pu / 6.3f;
+    return { kp, ti > 0 ? kp / ti : 0, kp * td };
+  }
+};
+
+} // namespace autotune
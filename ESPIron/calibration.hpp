@@ -0,0 +1,169 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include "fixed.hpp"
+
+#define CALIB_POINTS_MAX          8                     // max number of calibration points per tip
+#define CALIB_LUT_SHIFT           3                     // calibration LUT step is 2^shift C
+#define CALIB_LUT_SPAN            1024                  // calibration LUT covers measured temperatures 0 to span, C
+
+/**
+ * Tip temperature calibration
+ * measured (OpAmp linear fit) temperature is mapped to real tip temperature with a curve
+ * built over a number of calibration points, the curve is precomputed into a LUT with uniform step
+ * and conversion is a single table lookup with linear interpolation.
+ * No Arduino/IDF dependencies, could be built for the host as well
+ */
+namespace calib {
+
+struct Point {
+  int16_t measured;   // temperature read through OpAmp linear fit, C
+  int16_t actual;     // real tip temperature, C
+};
+
+enum class interp_t : uint8_t {
+  linear = 0,         // piecewise-linear
+  cubic               // monotone cubic Hermite
+};
+
+struct Curve {
+  // number of valid points
+  uint8_t n;
+  interp_t mode;
+  // calibration points sorted by measured temperature
+  std::array<Point, CALIB_POINTS_MAX> p;
+};
+
+/**
+ * @brief check if a curve could be used to build a LUT
+ * needs at least 2 points with strictly increasing measured temperatures
+ */
+constexpr bool valid(const Curve& c){
+  if (c.n < 2 || c.n > CALIB_POINTS_MAX) return false;
+  for (size_t i = 1; i < c.n; ++i)
+    if (c.p[i].measured <= c.p[i-1].measured) return false;
+  return true;
+}
+
+/**
+ * @brief lookup table with calibrated temperatures
+ */
+class LUT {
+public:
+  static constexpr int32_t step = 1 << CALIB_LUT_SHIFT;
+  static constexpr size_t size = (CALIB_LUT_SPAN >> CALIB_LUT_SHIFT) + 1;
+
+  // identity mapping
+  constexpr LUT(){
+    for (size_t i = 0; i != size; ++i)
+      _v[i] = static_cast<int32_t>(i * step) * q16_t::one;
+  }
+
+  /**
+   * @brief build LUT for a calibration curve
+   * points outside of calibrated range are extrapolated with the slope of the nearest segment,
+   * invalid curve results in identity mapping
+   */
+  static constexpr LUT build(const Curve& c){
+    LUT lut;
+    lut.load(c);
+    return lut;
+  }
+
+  /**
+   * @brief rebuild LUT in-place for a calibration curve
+   */
+  constexpr void load(const Curve& c){
+    if (!valid(c)){
+      *this = LUT();
+      return;
+    }
+
+    // Hermite tangents
+    std::array<float, CALIB_POINTS_MAX> m{};
+    _tangents(c, m);
+
+    for (size_t i = 0; i != size; ++i){
+      float v = _eval(c, m, static_cast<float>(i * step));
+      _v[i] = static_cast<int32_t>(v * q16_t::one + (v < 0 ? -0.5f : 0.5f));
+    }
+  }
+
+  /**
+   * @brief map measured temperature to calibrated one
+   */
+  constexpr q16_t map(q16_t t) const {
+    int32_t raw = t.raw();
+    if (raw < 0) raw = 0;
+    constexpr int32_t bin_bits = 16 + CALIB_LUT_SHIFT;
+    size_t i = raw >> bin_bits;
+    if (i > size - 2) i = size - 2;
+    int64_t frac = raw - (static_cast<int32_t>(i) << bin_bits);
+    return q16_t::fromRaw(_v[i] + static_cast<int32_t>(((_v[i+1] - _v[i]) * frac) >> bin_bits));
+  }
+
+  float map(float t) const { return static_cast<float>(map(q16_t(t))); }
+
+private:
+  std::array<int32_t, size> _v{};
+
+  static constexpr float _slope(const Curve& c, size_t i){
+    return static_cast<float>(c.p[i+1].actual - c.p[i].actual) / (c.p[i+1].measured - c.p[i].measured);
+  }
+
+  // Fritsch-Carlson tangents limited to 3x secant slope, which keeps interpolant monotone
+  static constexpr void _tangents(const Curve& c, std::array<float, CALIB_POINTS_MAX>& m){
+    if (c.mode != interp_t::cubic){
+      for (size_t i = 0; i != c.n - 1u; ++i) m[i] = _slope(c, i);
+      return;
+    }
+    m[0] = _slope(c, 0);
+    m[c.n - 1] = _slope(c, c.n - 2);
+    for (size_t i = 1; i < c.n - 1u; ++i){
+      float d0 = _slope(c, i - 1), d1 = _slope(c, i);
+      m[i] = (d0 * d1 <= 0) ? 0 : (d0 + d1) / 2;
+    }
+    for (size_t i = 0; i != c.n - 1u; ++i){
+      float d = _slope(c, i);
+      if (d == 0){
+        m[i] = m[i+1] = 0;
+        continue;
+      }
+      if (m[i] / d > 3) m[i] = 3 * d;
+      if (m[i+1] / d > 3) m[i+1] = 3 * d;
+    }
+  }
+
+  static constexpr float _eval(const Curve& c, const std::array<float, CALIB_POINTS_MAX>& m, float x){
+    // extrapolate below and above calibrated range
+    if (x <= c.p[0].measured)
+      return c.p[0].actual + _slope(c, 0) * (x - c.p[0].measured);
+    if (x >= c.p[c.n - 1].measured)
+      return c.p[c.n - 1].actual + _slope(c, c.n - 2) * (x - c.p[c.n - 1].measured);
+
+    size_t i = 0;
+    while (x > c.p[i+1].measured) ++i;
+    float h = c.p[i+1].measured - c.p[i].measured;
+    float s = (x - c.p[i].measured) / h;
+    if (c.mode != interp_t::cubic)
+      return c.p[i].actual + s * (c.p[i+1].actual - c.p[i].actual);
+
+    float s2 = s * s, s3 = s2 * s;
+    return (2 * s3 - 3 * s2 + 1) * c.p[i].actual + (s3 - 2 * s2 + s) * h * m[i]
+         + (-2 * s3 + 3 * s2) * c.p[i+1].actual + (s3 - s2) * h * m[i+1];
+  }
+};
+
+} // namespace calib
@@ -35,7 +35,12 @@
 // Heater PWM parameters
 #define HEATER_CHANNEL    LEDC_CHANNEL_2     // PWM channel
 #define HEATER_FREQ       200   // PWM frequency
-#define HEATER_RES        LEDC_TIMER_8_BIT     // PWM resolution
+#define HEATER_RES        LEDC_TIMER_12_BIT    // PWM resolution, 8 to 14 bits, PID gains are kept in 8-bit duty scale for any resolution
+#define HEATER_PWM_SYNC                         // measure tip temperature in a natural PWM off-phase without switching heater off (when duty allows)
+//#define HEATER_FIXED_POINT                    // use Q16.16 fixed-point math for tip temperature conversion, smoothing and PID instead of float
+#define HEATER_RAMP_SCURVE                      // soft-start power ramp follows an S-curve, otherwise it is linear
+//#define HEATER_HW_TICK                        // trigger control loop ticks from a GPTimer interrupt and run heater task at high priority, otherwise RTOS task delay is used
+#define HEATER_TEMP_ESTIMATOR                   // estimate tip temperature with a Kalman filter fusing ADC readings and applied heater power (float math), otherwise SMOOTHIE exponential filter is used
 
 // Default temperature control value (recommended soldering temperature: 300~380°C)
 // 默认温度控制值(推荐焊接温度:300~380°C)
@@ -108,3 +113,10 @@
 // timers
 #define VIN_REFRESH_INTERVAL    500     // Vin readings period, ms
 
+// power budget, heater duty is capped to keep average supply current within the limit
+#define PD_CURRENT_LIMIT        3000    // PD trigger contract current, mA (fixed PDOs are 3A for most chargers)
+#define QC_CURRENT_LIMIT        1500    // QC supply current, mA (18W chargers give 1.5A at 12V)
+#define HEATER_TIP_R_MOHM       4000    // nominal tip heater resistance, mOhm
+#define HEATER_SUPPLY_R_MOHM    200     // supply path resistance (charger, cable, MOSFET) estimate, mOhm, scales tip resistance estimated from Vin droop
+#define VIN_DIVIDER             31.3f   // Vin sense divider ratio, not sure where it comes from, need real schematics of this Iron
+
@@ -9,12 +9,14 @@ static constexpr const char* T_DBG = "DBG";
 static constexpr const char* T_GYRO = "GYRO";
 static constexpr const char* T_PWM = "PWM";
 static constexpr const char* T_HEAT = "HEAT";
+static constexpr const char* T_SIM = "SIM";
 
 // NVS namespaces
 static constexpr const char* T_IRON = "IRON";
 static constexpr const char* T_Sensor = "Sensor";
 static constexpr const char* T_UI = "UI";
 static constexpr const char* T_HID = "HID";
+static constexpr const char* T_Tips = "Tips";
 
 // NVS keys
 static constexpr const char* T_timeouts = "timeouts";                   // blob with timeout values
@@ -24,3 +26,4 @@ static constexpr const char* T_pdVolts = "pdVolts";                     // PD tr
 static constexpr const char* T_qcVolts = "qcVolts";                     // QC trigger voltage
 static constexpr const char* T_qcMode = "qcMode";                       // QC Mode
 static constexpr const char* T_PWMRamp = "PWMRamp";                     // PWM Power ramping
+static constexpr const char* T_tip = "tip";                             // current tip index (uint32), tip profile blobs are stored under keys 'tip<index>'
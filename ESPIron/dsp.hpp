@@ -0,0 +1,214 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <array>
+#include <type_traits>
+#include <utility>
+
+// max number of samples sorted with an unrolled sorting network, larger blocks are handled with nth_element
+#ifndef DSP_SORTNET_MAX
+#define DSP_SORTNET_MAX   32
+#endif
+
+/**
+ * Sample block filtering kernels
+ * no Arduino/IDF dependencies, could be built for the host as well
+ */
+namespace dsp {
+
+/**
+ * @brief Batcher's odd-even merge sorting network generated at compile time
+ * networks for non power of 2 sizes are made by dropping comparators that refer to elements beyond N
+ *
+ * @tparam N number of elements to sort
+ */
+template <size_t N>
+class SortNet {
+  template <typename F>
+  static constexpr void _generate(F&& f){
+    for (size_t p = 1; p < N; p += p)
+      for (size_t k = p; k > 0; k /= 2)
+        for (size_t j = k % p; j + k < N; j += k + k)
+          for (size_t i = 0; i < k && i + j + k < N; ++i)
+            if ((i + j) / (p + p) == (i + j + k) / (p + p))
+              f(i + j, i + j + k);
+  }
+
+  static constexpr size_t _count(){
+    size_t cnt{0};
+    _generate([&cnt](size_t, size_t){ ++cnt; });
+    return cnt;
+  }
+
+  struct Comparators {
+    std::array<std::pair<uint16_t, uint16_t>, _count()> v{};
+    constexpr Comparators(){
+      size_t idx{0};
+      _generate([this, &idx](size_t a, size_t b){ v[idx].first = a; v[idx].second = b; ++idx; });
+    }
+  };
+
+public:
+  // number of compare-exchange operations in a network
+  static constexpr size_t size = _count();
+  // comparator pairs
+  static constexpr Comparators net{};
+
+  /**
+   * @brief sort array in-place, network is fully unrolled
+   */
+  template <typename T>
+  static void sort(std::array<T, N>& a){ _sort(a, std::make_index_sequence<size>{}); }
+
+private:
+  template <typename T>
+  static inline void _cmpswap(T& a, T& b){
+    T lo = std::min(a, b);
+    b = std::max(a, b);
+    a = lo;
+  }
+
+  template <typename T, size_t... I>
+  static inline void _sort(std::array<T, N>& a, std::index_sequence<I...>){
+    (_cmpswap(a[net.v[I].first], a[net.v[I].second]), ...);
+  }
+};
+
+/**
+ * @brief partialy order array so that elements [Lo, Hi) are in place as they would be in a sorted array
+ * elements inside the range are not guaranteed to be sorted for large blocks
+ *
+ * @tparam Lo first element of a range
+ * @tparam Hi past-the-last element of a range
+ */
+template <size_t Lo, size_t Hi, typename T, size_t N>
+inline void select_range(std::array<T, N>& a){
+  static_assert(Lo < Hi && Hi <= N, "wrong selection range");
+  if constexpr (N <= DSP_SORTNET_MAX){
+    SortNet<N>::sort(a);
+  } else {
+    std::nth_element(a.begin(), a.begin() + Lo, a.end());
+    std::nth_element(a.begin() + Lo, a.begin() + Hi - 1, a.end());
+  }
+}
+
+/**
+ * @brief trimmed mean of a sample block
+ * drops Trim lowest and Trim highest samples and averages the rest, array is reordered in-place
+ *
+ * @tparam Trim number of samples to drop from each end
+ * @return T average of the middle N - 2*Trim samples
+ */
+template <size_t Trim, typename T, size_t N>
+T trimmed_mean(std::array<T, N>& a){
+  static_assert(2 * Trim < N, "trim width is too large for a sample block");
+  using acc_t = std::conditional_t<std::is_floating_point<T>::value, T, std::conditional_t<std::is_signed<T>::value, int64_t, uint64_t> >;
+
+  select_range<Trim, N - Trim>(a);
+  acc_t sum{0};
+  for (size_t i = Trim; i != N - Trim; ++i)
+    sum += a[i];
+  return static_cast<T>(sum / static_cast<acc_t>(N - 2 * Trim));
+}
+
+/**
+ * @brief median of a sample block, array is reordered in-place
+ * for even N an average of two middle samples is returned
+ */
+template <typename T, size_t N>
+T median(std::array<T, N>& a){
+  return trimmed_mean<(N - 1) / 2>(a);
+}
+
+/**
+ * @brief tracks exponential recovery of a signal sampled in blocks, i.e. OpAmp output after heater switch-off
+ * for an exponential tail steps between consecutive equally spaced blocks shrink by a constant ratio, which is
+ * a property of the circuit and is learned from recoveries seen. Remaining distance to the settled value is then
+ * step * r / (1 - r), so a reading is taken once that residual is within tolerance, or is corrected by it
+ * when it is small enough to be trusted and recovery does follow the learned ratio
+ */
+class Recovery {
+  int32_t _tol, _learn, _extrap;
+  // learned step ratio, 0 if unknown
+  float _r{0};
+  int32_t _prev{0}, _step{0};
+  // last step is smaller than the one before
+  bool _shrink{false};
+  // blocks fed since start()
+  uint32_t _n{0};
+
+public:
+  /**
+   * @param tol residual the signal is considered settled within
+   * @param learn min step ratio is learned from, steps close to noise floor give noisy ratios
+   * @param extrap max residual a reading could be corrected by
+   */
+  Recovery(int32_t tol, int32_t learn, int32_t extrap) : _tol(tol), _learn(learn), _extrap(extrap) {}
+
+  // begin a new recovery
+  void start(){ _n = 0; }
+
+  // forget learned ratio, i.e. circuit has changed
+  void reset(){ _r = 0; _n = 0; }
+
+  /**
+   * @brief feed next block value
+   *
+   * @param v block value
+   * @param settled settled value estimate, set when true is returned
+   * @return true if settled value is known
+   */
+  bool feed(int32_t v, int32_t& settled){
+    if (!_n++){
+      _prev = v;
+      return false;
+    }
+    int32_t step = _prev - v;
+    float k = _r / (1 - _r);
+    // until ratio is learned, step itself is taken as residual
+    int32_t residual = _r ? static_cast<int32_t>(step * k) : step;
+    // recovery follows learned ratio, previous step predicts this one within tolerance
+    bool regular = _n > 2 && _r && std::abs(step - static_cast<int32_t>(_step * _r)) <= _tol;
+    // residual within tolerance is left as is, correction would only add step's noise
+    bool ok{true};
+    if (std::abs(residual) <= _tol)
+      settled = v;
+    else if (regular && std::abs(residual) <= _extrap)
+      settled = v - residual;
+    else
+      ok = false;
+
+    // steps of one sign that shrink are an exponential tail, learn it's ratio
+    _shrink = _n > 2 && (step > 0) == (_step > 0) && std::abs(step) < std::abs(_step);
+    if (_shrink && std::abs(_step) >= _learn){
+      float r = static_cast<float>(step) / _step;
+      _r = _r ? _r + (r - _r) / 8 : r;
+    }
+    _prev = v;
+    _step = step;
+    return ok;
+  }
+
+  // signal is still approaching settled value, steps shrink
+  bool falling() const { return _shrink; }
+
+  // number of blocks fed since start()
+  uint32_t blocks() const { return _n; }
+
+  // learned step ratio, 0 if unknown
+  float ratio() const { return _r; }
+};
+
+} // namespace dsp
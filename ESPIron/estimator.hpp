@@ -0,0 +1,117 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+
+/**
+ * Tip temperature state estimation
+ * no Arduino/IDF dependencies, could be built for the host and run against thermalsim::TipPlant
+ */
+namespace estimator {
+
+struct ModelParams {
+  float heat_rate{40.0f};     // tip heating rate at full power (on reference voltage) and ambient temperature, C/sec
+  float loss{0.015f};         // heat loss coefficient, 1/sec
+  float t_amb{25.0f};         // ambient temperature, C
+  float q_temp{1.0f};         // temperature process noise density, C^2/sec
+  float q_dist{20.0f};        // disturbance rate process noise density, (C/sec)^2/sec
+  float r_meas{1.0f};         // measurement noise variance, C^2
+  float gate{50.0f};          // innovation that resets the filter to measured value, C
+};
+
+/**
+ * @brief Kalman filter for tip temperature
+ * tip is modeled as a first order thermal plant driven by heater power
+ *   dT/dt = heat_rate * u - loss * (T - T_amb) + d
+ * where u is heater power share and d is an unmodeled disturbance (i.e. a thermal load or model mismatch),
+ * that is estimated as a random walk. State vector is {T, d}.
+ * Prediction uses known applied power, so the estimate follows heat-up without the lag of an exponential filter,
+ * while measurement noise is still averaged out
+ */
+class TipKalman {
+  ModelParams _m;
+  // state
+  float _t{0}, _d{0};
+  // last power share used for prediction
+  float _u{0};
+  // covariance
+  float _p00{0}, _p01{0}, _p10{0}, _p11{0};
+
+public:
+  explicit TipKalman(const ModelParams& m = ModelParams()) : _m(m) {}
+
+  const ModelParams& params() const { return _m; }
+
+  /**
+   * @brief reset estimate to a measured temperature
+   */
+  void reset(float t){
+    _t = t;
+    _d = _u = 0;
+    _p00 = _m.r_meas;
+    _p11 = _m.q_dist;
+    _p01 = _p10 = 0;
+  }
+
+  /**
+   * @brief propagate state with applied heater power
+   *
+   * @param dt time since last prediction, sec
+   * @param u heater power share applied over dt, 1.0 is full power at reference voltage
+   */
+  void predict(float dt, float u){
+    _u = u;
+    float f00 = 1.0f - _m.loss * dt;
+    _t = f00 * _t + dt * (_m.heat_rate * u + _m.loss * _m.t_amb + _d);
+
+    // P = F*P*F' + Q, F = {{f00, dt}, {0, 1}}
+    float p00 = f00 * (f00 * _p00 + dt * _p10) + dt * (f00 * _p01 + dt * _p11) + _m.q_temp * dt;
+    float p01 = f00 * _p01 + dt * _p11;
+    float p10 = f00 * _p10 + dt * _p11;
+    _p00 = p00;
+    _p01 = p01;
+    _p10 = p10;
+    _p11 += _m.q_dist * dt;
+  }
+
+  /**
+   * @brief correct estimate with a temperature measurement
+   *
+   * @param z measured temperature, C
+   */
+  void update(float z){
+    float y = z - _t;
+    // estimate has lost track (i.e. tip has been replaced), start over
+    if (y > _m.gate || y < -_m.gate){
+      reset(z);
+      return;
+    }
+
+    float s = _p00 + _m.r_meas;
+    float k0 = _p00 / s, k1 = _p10 / s;
+    _t += k0 * y;
+    _d += k1 * y;
+
+    float p00 = _p00, p01 = _p01;
+    _p00 -= k0 * p00;
+    _p01 -= k0 * p01;
+    _p10 -= k1 * p00;
+    _p11 -= k1 * p01;
+  }
+
+  // estimated temperature, C
+  float temp() const { return _t; }
+
+  // estimated rate of temperature change, C/sec
+  float rate() const { return _m.heat_rate * _u - _m.loss * (_t - _m.t_amb) + _d; }
+};
+
+} // namespace estimator
@@ -10,7 +10,13 @@
     (at your option) any later version.
 */
 #include <Arduino.h>
+#include <array>
+#include <cstring>
+#include <list>
+#include <mutex>
 #include "esp32-hal.h"
+#include "esp_timer.h"
+#include "freertos/timers.h"
 #include "evtloop.hpp"
 
 // LOGGING
@@ -34,8 +40,10 @@ ESP_EVENT_DEFINE_BASE(IRON_HEATER);
 
 namespace evt {
 
-#define LOOP_EVT_Q_SIZE         16             // events loop queue size
-#define LOOP_EVT_PRIORITY       1              // task priority is same as arduino's loop() to avoid extra context switches
+#define LOOP_EVT_Q_SIZE         16             // UI lane events loop queue size
+#define LOOP_EVT_PRIORITY       1              // UI lane task priority is same as arduino's loop() to avoid extra context switches
+#define LOOP_CTRL_Q_SIZE        8              // control lane events loop queue size
+#define LOOP_CTRL_PRIORITY      2              // control lane task priority, above UI lane, display and arduino's loop(), below heater task with HEATER_HW_TICK
 #define LOOP_EVT_RUNNING_CORE   tskNO_AFFINITY // ARDUINO_RUNNING_CORE
 #ifdef PTS200_DEBUG_LEVEL
  #define LOOP_EVT_STACK_SIZE     4096          // loop task stack size when debug is enabled, sprintf calls requires lots of mem
@@ -43,35 +51,400 @@ namespace evt {
  #define LOOP_EVT_STACK_SIZE     4096          // loop task stack size
 #endif
 
+namespace latest {
+  mbox::Mailbox<uint32_t> vin;
+  mbox::Mailbox<int32_t> tiptemp;
+  mbox::Mailbox<float> acceltemp;
+}
+
+static_assert(EVT_STATS_PENDING > LOOP_EVT_Q_SIZE + LOOP_CTRL_Q_SIZE, "latency tracking must cover full loop queues");
+
+// statistics for a single base:id pair, times are in us
+struct EventStats {
+  esp_event_base_t base;
+  int32_t id;
+  bool tracked;             // has ever been posted with evt::post(), such events are tracked in loop depth and latency
+  int8_t coalesce;          // coalesce buffer index, -1 if none
+  uint32_t queued;          // events posted with evt::post() awaiting dispatch
+  uint32_t posts;           // posted with evt::post()
+  uint32_t drops;           // posts dropped on a full queue timeout
+  uint32_t coalesced;       // posts merged into an already queued event
+  uint32_t dispatched;      // dispatched by the loop, including events posted bypassing evt::post()
+  uint32_t block_max;       // time a poster was blocked on a full queue
+  uint64_t block_sum;
+  uint32_t wait_max;        // post to dispatch latency
+  uint64_t wait_sum;
+  uint32_t waits;
+  uint32_t run_max;         // single handler run time
+  uint64_t run_sum;
+  uint32_t runs;
+};
+
+// posted event awaiting dispatch
+struct Pending {
+  int32_t slot;             // stats slot, -1 if free
+  int64_t ts;               // post time
+};
+
+// latest payload for a queued event that has been coalesced
+struct Coalesced {
+  bool pending;
+  uint8_t size;
+  uint8_t data[EVT_COALESCE_MAX_SIZE];
+};
+
+// loop task of a lane
+struct Lane {
+  const char* name;
+  int32_t queue_size;
+  UBaseType_t priority;
+  esp_event_loop_handle_t loop{nullptr};
+  // loop task, set on first dispatch, posts from it can't wait for a full queue of it's own or a lower priority lane
+  TaskHandle_t task{nullptr};
+  // stats slot of the event being dispatched, accessed from loop task only
+  EventStats* cur{nullptr};
+  // events posted with evt::post() that are either queued or have their posters blocked on a full queue, guarded by _mux
+  uint32_t depth{0}, depth_max{0};
+  esp_event_handler_instance_t dispatch_hndlr{nullptr};
+};
+
+// a handler subscribed with evt::subscribe()
+struct Hook {
+  esp_event_handler_t fn;
+  void* arg;
+  esp_event_handler_instance_t instance;
+};
+
+static portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+// statistics hash table, guarded by _mux
+static std::array<EventStats, EVT_STATS_SLOTS> _stats{};
+static std::array<Pending, EVT_STATS_PENDING> _pending;
+static std::array<Coalesced, EVT_COALESCE_SLOTS> _coalesced{};
+static size_t _coalesced_cnt{0};
+// lanes in lane_t order
+static std::array<Lane, e2int(lane_t::count)> _lanes {{
+  { "evt_ctrl", LOOP_CTRL_Q_SIZE, LOOP_CTRL_PRIORITY },
+  { "evt_loop", LOOP_EVT_Q_SIZE, LOOP_EVT_PRIORITY }
+}};
+
+static std::list<Hook> _hooks;
+static std::mutex _hooks_mtx;
+
+static esp_event_handler_instance_t _req_hndlr{nullptr};
+
+static Lane& _lane(esp_event_base_t base){ return _lanes[e2int(lane(base))]; }
+
+// find or create stats slot for base:id, must be called under _mux
+static EventStats* _slot(esp_event_base_t base, int32_t id){
+  size_t i = (reinterpret_cast<uintptr_t>(base) ^ static_cast<uint32_t>(id) * 2654435761u) % EVT_STATS_SLOTS;
+  for (size_t n = 0; n != EVT_STATS_SLOTS; ++n, i = (i + 1) % EVT_STATS_SLOTS){
+    if (_stats[i].base == base && _stats[i].id == id) return &_stats[i];
+    if (!_stats[i].base){
+      _stats[i].base = base;
+      _stats[i].id = id;
+      _stats[i].coalesce = -1;
+      return &_stats[i];
+    }
+  }
+  // table is full
+  return nullptr;
+}
+
+// record a post, must be called under _mux, returns pending slot for latency tracking or -1
+static int _on_post(Lane& l, EventStats* s, int64_t ts){
+  s->tracked = true;
+  ++s->posts;
+  ++s->queued;
+  if (++l.depth > l.depth_max) l.depth_max = l.depth;
+  for (size_t i = 0; i != _pending.size(); ++i){
+    if (_pending[i].slot < 0){
+      _pending[i] = { static_cast<int32_t>(s - _stats.data()), ts };
+      return i;
+    }
+  }
+  return -1;
+}
+
+// record failed post, must be called under _mux
+static void _on_post_fail(Lane& l, EventStats* s, int pending){
+  ++s->drops;
+  if (s->queued) --s->queued;
+  if (l.depth) --l.depth;
+  if (pending >= 0) _pending[pending].slot = -1;
+  // payload has been merged into a post that never made it to the queue, it's dropped along with it,
+  // otherwise it would be copied over the next event of the same id
+  if (!s->queued && s->coalesce >= 0 && _coalesced[s->coalesce].pending){
+    _coalesced[s->coalesce].pending = false;
+    ++s->drops;
+  }
+}
+
+// loop-level handler, it's registered first and runs before any other handler for each event, arg is lane
+static void _on_dispatch(void* arg, esp_event_base_t base, int32_t id, void* data){
+  Lane& l = *static_cast<Lane*>(arg);
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_mux);
+  EventStats* s = _slot(base, id);
+  if (s){
+    ++s->dispatched;
+    // only events posted with evt::post() are tracked in depth and latency
+    if (s->tracked){
+      if (l.depth) --l.depth;
+      if (s->queued) --s->queued;
+      // later posts have been merged into this event, handlers get the latest payload
+      if (s->coalesce >= 0){
+        Coalesced &c = _coalesced[s->coalesce];
+        if (c.pending && data) std::memcpy(data, c.data, c.size);
+        c.pending = false;
+      }
+      // events with same base:id are dispatched in post order, take the oldest one
+      int32_t slot = s - _stats.data();
+      Pending* p{nullptr};
+      for (auto &i : _pending)
+        if (i.slot == slot && (!p || i.ts < p->ts)) p = &i;
+      if (p){
+        uint32_t wait = now - p->ts;
+        p->slot = -1;
+        ++s->waits;
+        s->wait_sum += wait;
+        if (wait > s->wait_max) s->wait_max = wait;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&_mux);
+  l.cur = s;
+  l.task = xTaskGetCurrentTaskHandle();
+}
+
+// wrapper that measures subscribed handler's run time
+static void _run_hook(void* arg, esp_event_base_t base, int32_t id, void* data){
+  Hook* h = static_cast<Hook*>(arg);
+  int64_t t = esp_timer_get_time();
+  h->fn(h->arg, base, id, data);
+  uint32_t run = esp_timer_get_time() - t;
+
+  EventStats* s = _lane(base).cur;
+  if (!s) return;
+  portENTER_CRITICAL(&_mux);
+  ++s->runs;
+  s->run_sum += run;
+  if (run > s->run_max) s->run_max = run;
+  portEXIT_CRITICAL(&_mux);
+}
+
 void start(){
-  if (hndlr) return;
+  if (_lanes[e2int(lane_t::ui)].loop) return;
 
-  ESP_LOGI(TAG, "Cretating Event loop");
+  ESP_LOGI(TAG, "Cretating Event loops");
+  for (auto &p : _pending) p.slot = -1;
+
+  for (auto &l : _lanes){
+#ifdef EVT_SINGLE_LOOP
+    // everything goes through UI lane
+    if (&l != &_lanes[e2int(lane_t::ui)]) continue;
+#endif
+    esp_event_loop_args_t evt_cfg;
+    evt_cfg.queue_size = l.queue_size;
+    evt_cfg.task_name = l.name;
+    evt_cfg.task_priority = l.priority;
+    evt_cfg.task_stack_size = LOOP_EVT_STACK_SIZE;
+    evt_cfg.task_core_id = LOOP_EVT_RUNNING_CORE;
 
-  esp_event_loop_args_t evt_cfg;
-  evt_cfg.queue_size = LOOP_EVT_Q_SIZE;
-  evt_cfg.task_name = "evt_loop";
-  evt_cfg.task_priority = LOOP_EVT_PRIORITY;            // uxTaskPriorityGet(NULL) // same as parent
-  evt_cfg.task_stack_size = LOOP_EVT_STACK_SIZE;
-  evt_cfg.task_core_id = LOOP_EVT_RUNNING_CORE;
+    esp_err_t err = esp_event_loop_create(&evt_cfg, &l.loop);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "event loop %s creation failed!", l.name);
+      return;
+    }
 
-  //ESP_ERROR_CHECK(esp_event_loop_create(&levt_cfg, &loop_levt_h));
-  esp_err_t err = esp_event_loop_create(&evt_cfg, &hndlr);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "event loop creation failed!");
+    // loop-level handlers run before base and id handlers, so it marks dispatch start of each event
+    esp_event_handler_instance_register_with(l.loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, _on_dispatch, &l, &l.dispatch_hndlr);
   }
+
+  subscribe(IRON_GET_EVT, e2int(iron_t::evtStats), [](void*, esp_event_base_t, int32_t, void*){ stats_print(); }, nullptr, &_req_hndlr);
 }
 
-void stop(){ esp_event_loop_delete(hndlr); hndlr = nullptr; };
+void stop(){
+  for (auto &l : _lanes){
+    if (l.loop) esp_event_loop_delete(l.loop);
+    l.loop = nullptr;
+    l.task = nullptr;
+    l.cur = nullptr;
+    l.dispatch_hndlr = nullptr;
+  }
+  _req_hndlr = nullptr;
+  std::lock_guard<std::mutex> lock(_hooks_mtx);
+  _hooks.clear();
+};
+
+esp_event_loop_handle_t get_hndlr(lane_t lane){ return _lanes[e2int(lane)].loop; };
 
-esp_event_loop_handle_t get_hndlr(){ return hndlr; };
+lane_t lane(esp_event_base_t base){
+#ifdef EVT_SINGLE_LOOP
+  (void)base;
+  return lane_t::ui;
+#else
+  return base == IRON_HEATER || base == SENSOR_DATA ? lane_t::control : lane_t::ui;
+#endif
+}
 
-void debug_hndlr(void* handler_args, esp_event_base_t base, int32_t id, void* event_data){
+void debug_hndlr(void*, esp_event_base_t base, int32_t id, void*){
   Serial.printf("evt tracker: %s:%d\n", base, id);
 }
 
 void debug(){
-    ESP_ERROR_CHECK( esp_event_handler_instance_register_with(hndlr, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, debug_hndlr, NULL, nullptr) );
+  for (auto &l : _lanes)
+    if (l.loop) ESP_ERROR_CHECK( esp_event_handler_instance_register_with(l.loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, debug_hndlr, NULL, nullptr) );
+}
+
+esp_err_t post(esp_event_base_t base, int32_t id, const void* data, size_t size, TickType_t ticks){
+  Lane& l = _lane(base);
+  int64_t t = esp_timer_get_time();
+  int pending{-1};
+  portENTER_CRITICAL(&_mux);
+  EventStats* s = _slot(base, id);
+  if (s) pending = _on_post(l, s, t);
+  portEXIT_CRITICAL(&_mux);
+
+  esp_err_t err = esp_event_post_to(l.loop, base, id, data, size, ticks);
+  if (!s) return err;
+
+  uint32_t blocked = esp_timer_get_time() - t;
+  portENTER_CRITICAL(&_mux);
+  if (err != ESP_OK) _on_post_fail(l, s, pending);
+  s->block_sum += blocked;
+  if (blocked > s->block_max) s->block_max = blocked;
+  portEXIT_CRITICAL(&_mux);
+  return err;
+}
+
+post_policy_t policy(esp_event_base_t base){
+  if (base == IRON_SET_EVT || base == IRON_GET_EVT || base == IRON_HEATER || base == IRON_VISET)
+    return post_policy_t::deliver;
+  return post_policy_t::bounded;
+}
+
+esp_err_t post(post_policy_t policy, esp_event_base_t base, int32_t id, const void* data, size_t size){
+  // a loop task could wait only for a higher priority lane, which never waits back, otherwise loops might wait for each other forever
+  bool can_wait = true;
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (size_t i = 0; i <= static_cast<size_t>(lane(base)); ++i)
+    if (_lanes[i].task == self) can_wait = false;
+  // timer service task must not block either, it would delay all software timers
+  if (self == xTimerGetTimerDaemonTaskHandle()) can_wait = false;
+
+  if (policy == post_policy_t::nowait)
+    return post(base, id, data, size, 0);
+
+  if (policy == post_policy_t::deliver && can_wait)
+    return post(base, id, data, size, portMAX_DELAY);
+
+  if (policy == post_policy_t::coalesce && size <= EVT_COALESCE_MAX_SIZE){
+    portENTER_CRITICAL(&_mux);
+    EventStats* s = _slot(base, id);
+    // bind a payload buffer on first use
+    if (s && s->coalesce < 0 && _coalesced_cnt != _coalesced.size())
+      s->coalesce = _coalesced_cnt++;
+    if (s && s->coalesce >= 0 && s->queued){
+      // same event is still in the queue, replace it's payload
+      Coalesced &c = _coalesced[s->coalesce];
+      if (size) std::memcpy(c.data, data, size);
+      c.size = size;
+      c.pending = true;
+      ++s->coalesced;
+      portEXIT_CRITICAL(&_mux);
+      return ESP_OK;
+    }
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  esp_err_t err = post(base, id, data, size, pdMS_TO_TICKS(EVT_POST_TIMEOUT_MS));
+  if (err != ESP_OK && policy == post_policy_t::deliver){
+    ESP_LOGE(TAG, "loop queue is full, command %s:%d dropped", base, id);
+  }
+  return err;
+}
+
+esp_err_t post_isr(esp_event_base_t base, int32_t id, const void* data, size_t size, BaseType_t* task_awoken){
+  Lane& l = _lane(base);
+  int pending{-1};
+  portENTER_CRITICAL_ISR(&_mux);
+  EventStats* s = _slot(base, id);
+  if (s) pending = _on_post(l, s, esp_timer_get_time());
+  portEXIT_CRITICAL_ISR(&_mux);
+
+  esp_err_t err = esp_event_isr_post_to(l.loop, base, id, data, size, task_awoken);
+  if (s && err != ESP_OK){
+    portENTER_CRITICAL_ISR(&_mux);
+    _on_post_fail(l, s, pending);
+    portEXIT_CRITICAL_ISR(&_mux);
+  }
+  return err;
+}
+
+esp_err_t subscribe(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void* arg, esp_event_handler_instance_t* instance){
+  std::lock_guard<std::mutex> lock(_hooks_mtx);
+  // list keeps hook address stable, it is passed to the loop as handler's arg
+  Hook &h = _hooks.emplace_back(Hook{handler, arg, nullptr});
+  esp_err_t err = esp_event_handler_instance_register_with(_lane(base).loop, base, id, _run_hook, &h, &h.instance);
+  if (err != ESP_OK){
+    _hooks.pop_back();
+    return err;
+  }
+  if (instance) *instance = h.instance;
+  return ESP_OK;
+}
+
+esp_err_t unsubscribe(esp_event_base_t base, int32_t id, esp_event_handler_instance_t instance){
+  std::lock_guard<std::mutex> lock(_hooks_mtx);
+  // loop does not run handlers while unregistering, so hook could be released right after
+  esp_err_t err = esp_event_handler_instance_unregister_with(_lane(base).loop, base, id, instance);
+  if (err == ESP_OK)
+    _hooks.remove_if([instance](const Hook &h){ return h.instance == instance; });
+  return err;
+}
+
+void stats_print(){
+  for (size_t n = 0; n != _lanes.size(); ++n){
+    const Lane &l = _lanes[n];
+    if (!l.loop) continue;
+    // worst command latency in the lane
+    uint32_t cmd_wait_max{0};
+    portENTER_CRITICAL(&_mux);
+    uint32_t depth = l.depth, depth_max = l.depth_max;
+    for (const auto &s : _stats)
+      if (s.base && static_cast<size_t>(lane(s.base)) == n && policy(s.base) == post_policy_t::deliver && s.wait_max > cmd_wait_max)
+        cmd_wait_max = s.wait_max;
+    portEXIT_CRITICAL(&_mux);
+    Serial.printf("%s depth: %u, max: %u, queue: %d, prio: %u, command latency max: %u us\n", l.name, depth, depth_max, l.queue_size, l.priority, cmd_wait_max);
+  }
+  Serial.println("base:id posts drops coalesced dispatched | block max/avg us | wait max/avg us | run max/avg us");
+
+  for (size_t i = 0; i != _stats.size(); ++i){
+    portENTER_CRITICAL(&_mux);
+    EventStats s = _stats[i];
+    portEXIT_CRITICAL(&_mux);
+    if (!s.base) continue;
+    Serial.printf("%s:%d %u %u %u %u | %u/%u | %u/%u | %u/%u\n", s.base, s.id, s.posts, s.drops, s.coalesced, s.dispatched,
+      s.block_max, s.posts ? static_cast<uint32_t>(s.block_sum / s.posts) : 0,
+      s.wait_max, s.waits ? static_cast<uint32_t>(s.wait_sum / s.waits) : 0,
+      s.run_max, s.runs ? static_cast<uint32_t>(s.run_sum / s.runs) : 0);
+  }
+}
+
+void stats_reset(){
+  portENTER_CRITICAL(&_mux);
+  // keep base:id keys, slots are referenced by pending events and the handler being run
+  for (auto &s : _stats){
+    EventStats z{};
+    z.base = s.base;
+    z.id = s.id;
+    z.tracked = s.tracked;
+    z.coalesce = s.coalesce;
+    z.queued = s.queued;
+    s = z;
+  }
+  for (auto &l : _lanes) l.depth_max = l.depth;
+  portEXIT_CRITICAL(&_mux);
 }
 
 } // namespace evt
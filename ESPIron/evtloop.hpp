@@ -12,11 +12,20 @@
 #pragma once
 #include "esp_event.h"
 #include <type_traits>
+#include "mailbox.hpp"
 
 // helper macro to reduce typing
-#define EVT_POST(event_base, event_id) esp_event_post_to(evt::get_hndlr(), event_base, event_id, NULL, 0, portMAX_DELAY)
-#define EVT_POST_DATA(event_base, event_id, event_data, data_size) esp_event_post_to(evt::get_hndlr(), event_base, event_id, event_data, data_size, portMAX_DELAY)
-#define EVT_POST_ISR(event_base, event_id, tsk_awoken) esp_event_isr_post_to(evt::get_hndlr(), event_base, event_id, NULL, 0, tsk_awoken)
+// post policy is picked by event base, see evt::policy()
+#define EVT_POST(event_base, event_id) evt::post(evt::policy(event_base), event_base, event_id)
+#define EVT_POST_DATA(event_base, event_id, event_data, data_size) evt::post(evt::policy(event_base), event_base, event_id, event_data, data_size)
+#define EVT_POST_COALESCE(event_base, event_id, event_data, data_size) evt::post(evt::post_policy_t::coalesce, event_base, event_id, event_data, data_size)
+#define EVT_POST_ISR(event_base, event_id, tsk_awoken) evt::post_isr(event_base, event_id, NULL, 0, tsk_awoken)
+
+#define EVT_STATS_SLOTS           64            // max number of distinct base:id pairs event loop statistics are kept for
+#define EVT_STATS_PENDING         32            // max number of posted events tracked for dispatch latency, must be above total size of loop queues
+#define EVT_POST_TIMEOUT_MS       10            // max time a droppable event post waits for room in a full loop queue, ms
+#define EVT_COALESCE_SLOTS        8             // max number of base:id pairs that could be coalesced
+#define EVT_COALESCE_MAX_SIZE     16            // max payload size of a coalesced event, bytes
 
 // ESP32 event loop defines
 ESP_EVENT_DECLARE_BASE(SENSOR_DATA);        // events coming from different sensors, i.e. temperature, voltage, orientation, etc...
@@ -37,15 +46,42 @@ e2int(E e) {
 // ESPIron Event Loop
 namespace evt {
 
+/**
+ * @brief event loop lanes
+ * each lane is a separate loop task, events are routed to a lane by their base, so a burst of UI events
+ * or a slow menu handler does not delay heater commands. Lanes are ordered by priority, highest first
+ */
+enum class lane_t : uint8_t {
+  control = 0,      // heater commands and sensor data
+  ui,               // buttons, HID, iron commands and requests, notifications, state replies
+  count
+};
+
+// event post policies
+enum class post_policy_t : uint8_t {
+  deliver = 0,      // wait for room in the queue as long as it takes, for commands. Loop and timer service tasks wait up to EVT_POST_TIMEOUT_MS
+  bounded,          // wait up to EVT_POST_TIMEOUT_MS, event is dropped on timeout
+  coalesce,         // if an event with same base:id is still queued, it's payload is replaced with a new one, otherwise same as bounded
+  nowait            // never wait for room in the queue, caller keeps the event and posts it again later, i.e. on next heater tick
+};
+
+// supply contract, heater must not draw more than that
+struct PowerBudget {
+  // negotiated supply voltage, mV
+  uint32_t mv;
+  // current limit, mA, 0 for unlimited
+  uint32_t ma;
+};
+
 // ESPIron events
 enum class iron_t:int32_t {
   noop = 0,                 // 0-9 are reserved for something extraordinary
 
   // Sensors data 100-199
   motion=100,               // motion detected from GyroSensor
-  vin=110,                  // Vin voltage in millvolts, parameter uint32_t
-  tiptemp=120,              // current Tip temperature, parameter int32_t
-  acceltemp=121,            // accelerometer chip temperature, parameter float
+  vin=110,                  // Vin voltage in millvolts, uint32_t, published to evt::latest::vin
+  tiptemp=120,              // current Tip temperature, int32_t, published to evt::latest::tiptemp
+  acceltemp=121,            // accelerometer chip temperature, float, published to evt::latest::acceltemp
 
 
   // Commands
@@ -53,12 +89,17 @@ enum class iron_t:int32_t {
   workTemp,                 // set working temperature, parameter int32_t
   workModeToggle,           // toggle working mode on/off
   boostModeToggle,          // toggle boost mode on/off
+  modeTick,                 // iron controller mode timer tick, mode timeouts are checked in event loop
 
   // Heater Commands
   heaterTargetT = 250,      // set heater target temperature, parameter int32_t
   heaterEnable,
   heaterDisable,
   heaterRampUp,             // start PWM ramp heating, switch to enabled mode
+  heaterAutoTune,           // run PID autotune for current tip at current target temperature, heater must be enabled
+  heaterTipSelect,          // select tip profile, parameter uint32_t tip index
+  heaterTipCalibrate,       // set calibration curve for current tip, parameter calib::Curve
+  heaterPowerBudget,        // set supply power budget, parameter evt::PowerBudget (as IRON_GET_EVT - request current budget)
 
   reloadTemp,               // reload temperature configuration
   reloadTimeouts,           // reload timeouts configuration
@@ -68,6 +109,9 @@ enum class iron_t:int32_t {
   // Commands - power control
   pdVoltage,                // switch PD trigger, arg uint32_t in V
   qcVoltage,                // switch QC trigger, arg uint32_t in V
+
+  // Commands - diagnostics
+  evtStats,                 // (as IRON_GET_EVT) print event loop statistics to serial
 //  qc2enable,                // activate QC trigger in QC2 mode
 //  qc3enable,                // activate QC trigger in QC3 mode
 //  qcDisable,                // disable QC trigger
@@ -85,25 +129,39 @@ enum class iron_t:int32_t {
   statePWRRampCmplt,        // Iron has completed power ramping
   tipEject,                 // sent by heater when it looses the tip sense
   tipInsert,                // sent by heater when detect tip sensor
+  autotuneCmplt,            // PID autotune succeeded, parameter TipProfile with new gains
+  autotuneFail,             // PID autotune failed or aborted
+  heaterFault,              // heater fault detected, heater is shut off until power cycle, parameter faults::fault_t (uint32_t)
+  heaterLoad,               // thermal load detected on the tip, parameter float tip temperature rate, C/sec
+  tipResistance,            // tip heater resistance measured on tip insert, parameter uint32_t mOhm
+  tipRequest,               // tip select/calibrate commands are waiting in heater mailboxes to be handled in UI lane
 
   // END
   noop_end                  // stub
 };
 
 
-  // Event loop handler
-  static esp_event_loop_handle_t hndlr = nullptr;
+  /**
+   * @brief latest sensor readings
+   * high-rate sensor data is not posted to the loop, producers overwrite the latest value and consumers read it on demand,
+   * so slow consumers do not pile up stale samples in the loop queue
+   */
+  namespace latest {
+    extern mbox::Mailbox<uint32_t> vin;
+    extern mbox::Mailbox<int32_t> tiptemp;
+    extern mbox::Mailbox<float> acceltemp;
+  }
 
   /**
-   * @brief Start ESPIron's event loop task
-   * this loop will manage events handling amoung application's components and controls
+   * @brief Start ESPIron's event loop tasks
+   * this loops will manage events handling amoung application's components and controls, one loop per lane
    *
    * @return esp_event_loop_handle_t* a pointer to loop handle
    */
   void start();
 
   /**
-   * @brief Stops ESPIron's event loop task
+   * @brief Stops ESPIron's event loop tasks
    *
    * @return esp_event_loop_handle_t* a pointer to loop handle
    */
@@ -111,12 +169,69 @@ enum class iron_t:int32_t {
 
   /**
    * @brief Get event loop hndlr ptr
-   * 
+   * 3rd party libs that post to the loop directly (i.e. buttons) should use UI lane,
+   * subscriptions to their events with evt::subscribe() are routed there
+   *
+   * @param lane loop lane
    * @return esp_event_loop_handle_t 
    */
-  esp_event_loop_handle_t get_hndlr();
+  esp_event_loop_handle_t get_hndlr(lane_t lane = lane_t::ui);
+
+  /**
+   * @brief lane that handles events of a base
+   * IRON_HEATER and SENSOR_DATA are handled in control lane, anything else in UI lane.
+   * When built with EVT_SINGLE_LOOP flag, all events go through UI lane like with a single loop,
+   * this is for comparing latencies only
+   */
+  lane_t lane(esp_event_base_t base);
 
   // subscribe to all events on a bus and print debug messages
   void debug();
 
+  /**
+   * @brief post an event to the loop of event base's lane
+   * same as esp_event_post_to(), time the poster was blocked on a full queue and
+   * event's post to dispatch latency are recorded to loop statistics
+   */
+  esp_err_t post(esp_event_base_t base, int32_t id, const void* data = nullptr, size_t size = 0, TickType_t ticks = portMAX_DELAY);
+
+  /**
+   * @brief post an event to the loop with a policy
+   * deliver policy waits for room in the queue as long as it takes, except when posting from a loop task to it's own
+   * or a lower priority lane, the queue might never drain then, so it's bounded by timeout and error is logged on drop
+   */
+  esp_err_t post(post_policy_t policy, esp_event_base_t base, int32_t id, const void* data = nullptr, size_t size = 0);
+
+  /**
+   * @brief default post policy for event base
+   * commands and requests are always delivered, notifications, state replies and sensor events could be dropped
+   * when the loop is saturated, so that the heater task and timer callbacks are never stalled for long
+   */
+  post_policy_t policy(esp_event_base_t base);
+
+  // same as esp_event_isr_post_to(), event is recorded to loop statistics
+  esp_err_t post_isr(esp_event_base_t base, int32_t id, const void* data, size_t size, BaseType_t* task_awoken);
+
+  /**
+   * @brief subscribe to events on the loop of event base's lane
+   * same as esp_event_handler_instance_register_with(), handler's run time is recorded to loop statistics,
+   * ESP_EVENT_ANY_BASE subscriptions get UI lane events only
+   */
+  esp_err_t subscribe(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void* arg, esp_event_handler_instance_t* instance);
+
+  // unsubscribe handler instance obtained with subscribe()
+  esp_err_t unsubscribe(esp_event_base_t base, int32_t id, esp_event_handler_instance_t instance);
+
+  /**
+   * @brief print event loop statistics to serial
+   * per base:id post/dispatch counts, time posters were blocked on a full queue, post to dispatch latency and handlers run time,
+   * loop depth counts events posted with evt::post() which are either queued or have their posters blocked on a full queue,
+   * command latency is the worst post to dispatch time of deliver policy events in a lane.
+   * Events posted by 3rd party libs directly to the loop (i.e. buttons) are seen on dispatch only
+   */
+  void stats_print();
+
+  // clear event loop statistics
+  void stats_reset();
+
 } // namespace evt
@@ -0,0 +1,186 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <type_traits>
+#include "evtloop.hpp"
+#include "calibration.hpp"
+#include "faultdetect.hpp"
+
+// defined in heater.hpp, it's payload is never dereferenced here
+struct TipProfile;
+
+/**
+ * Typed event registry
+ * each iron_t event id is bound to a payload type at compile time, typed posts and handlers are
+ * checked against it, so payload mismatch is a build error, not a garbage read in some handler
+ */
+namespace evt {
+
+// payload type bound to event id, events without payload are bound to void
+template <iron_t Id> struct payload { using type = void; };
+template <iron_t Id> using payload_t = typename payload<Id>::type;
+
+#define EVT_PAYLOAD(event_id, T) template <> struct payload<iron_t::event_id> { using type = T; }
+
+// Sensors data
+EVT_PAYLOAD(vin, uint32_t);
+EVT_PAYLOAD(tiptemp, int32_t);
+EVT_PAYLOAD(acceltemp, float);
+// Commands
+EVT_PAYLOAD(workTemp, int32_t);
+EVT_PAYLOAD(heaterTargetT, int32_t);
+EVT_PAYLOAD(heaterTipSelect, uint32_t);
+EVT_PAYLOAD(heaterTipCalibrate, calib::Curve);
+EVT_PAYLOAD(heaterPowerBudget, PowerBudget);
+EVT_PAYLOAD(pdVoltage, uint32_t);
+EVT_PAYLOAD(qcVoltage, uint32_t);
+// State notifications
+EVT_PAYLOAD(stateBoost, uint32_t);
+EVT_PAYLOAD(autotuneCmplt, TipProfile);
+EVT_PAYLOAD(heaterFault, faults::fault_t);
+EVT_PAYLOAD(heaterLoad, float);
+EVT_PAYLOAD(tipResistance, uint32_t);
+
+#undef EVT_PAYLOAD
+
+/**
+ * @brief post an event with no payload
+ * overloads without policy use default policy for event base, see evt::policy()
+ */
+template <iron_t Id>
+esp_err_t post(post_policy_t policy, esp_event_base_t base){
+  static_assert(std::is_void_v<payload_t<Id>>, "event id is bound to a payload, it must be posted with one, use evt::request() for IRON_GET_EVT");
+  return post(policy, base, e2int(Id));
+}
+
+template <iron_t Id>
+esp_err_t post(esp_event_base_t base){ return post<Id>(policy(base), base); }
+
+/**
+ * @brief post an event with payload
+ * payload type must be exactly the one bound to event id, no implicit conversions
+ */
+template <iron_t Id, typename T>
+esp_err_t post(post_policy_t policy, esp_event_base_t base, const T& v){
+  static_assert(std::is_same_v<T, payload_t<Id>>, "payload type does not match the one bound to event id");
+  static_assert(std::is_trivially_copyable_v<T>, "payload is copied to the loop queue, it must be trivially copyable");
+  return post(policy, base, e2int(Id), &v, sizeof(T));
+}
+
+template <iron_t Id, typename T>
+esp_err_t post(esp_event_base_t base, const T& v){ return post<Id>(policy(base), base, v); }
+
+/**
+ * @brief request a value, posts IRON_GET_EVT with no payload
+ * reply comes as an event with same id and it's bound payload, usually to IRON_STATE base
+ */
+template <iron_t Id>
+esp_err_t request(){ return post(policy(IRON_GET_EVT), IRON_GET_EVT, e2int(Id)); }
+
+namespace detail {
+
+// handler signature, arg is void for handlers that take no payload
+template <typename F> struct handler_traits;
+template <class C, typename R> struct handler_traits<R (C::*)()> { using owner = C; using arg = void; };
+template <class C, typename R> struct handler_traits<R (C::*)() const> { using owner = C; using arg = void; };
+template <class C, typename R, typename A> struct handler_traits<R (C::*)(A)> { using owner = C; using arg = A; };
+template <class C, typename R, typename A> struct handler_traits<R (C::*)(A) const> { using owner = C; using arg = A; };
+
+constexpr bool unique(std::initializer_list<int32_t> ids){
+  for (auto i = ids.begin(); i != ids.end(); ++i)
+    for (auto j = i + 1; j != ids.end(); ++j)
+      if (*i == *j) return false;
+  return true;
+}
+
+template <class C, int32_t Lo, size_t N, class... Handlers>
+constexpr std::array<void (*)(C*, void*), N> make_table(){
+  std::array<void (*)(C*, void*), N> t{};
+  ((t[e2int(Handlers::id) - Lo] = &Handlers::template call<C>), ...);
+  return t;
+}
+
+} // namespace detail
+
+/**
+ * @brief binds event id to a member function handler
+ * handler takes either event's payload by value or const reference, or nothing if it is not interested in payload
+ */
+template <iron_t Id, auto Fn>
+struct on {
+  static constexpr iron_t id = Id;
+  using traits = detail::handler_traits<decltype(Fn)>;
+  using arg = typename traits::arg;
+
+  static_assert(std::is_void_v<arg> || std::is_same_v<std::remove_cv_t<std::remove_reference_t<arg>>, payload_t<Id>>,
+    "handler argument does not match payload type bound to event id");
+  static_assert(!std::is_reference_v<arg> || std::is_const_v<std::remove_reference_t<arg>>,
+    "payload is owned by the loop, handler must take it by value or const reference");
+
+  template <class C>
+  static void call(C* self, void* data){
+    static_assert(std::is_base_of_v<typename traits::owner, C>, "handler is not a member of subscriber");
+    if constexpr (std::is_void_v<arg>)
+      (self->*Fn)();
+    else if (data)
+      (self->*Fn)(*static_cast<const payload_t<Id>*>(data));
+  }
+};
+
+/**
+ * @brief flat dispatch table for event handlers of a subscriber
+ * handlers are placed in a constant table indexed by event id, so dispatch is a bounds check and an indirect call
+ * instead of a switch. Table spans from the lowest to the highest id bound, it's kept in flash.
+ * A table with a single handler subscribes to it's event id only, otherwise to any id on a base
+ *
+ * @tparam C subscriber class
+ * @tparam Handlers evt::on<> bindings
+ */
+template <class C, class... Handlers>
+class Dispatcher {
+  static_assert(sizeof...(Handlers), "dispatcher must have at least one handler");
+  static_assert(detail::unique({e2int(Handlers::id)...}), "event id is bound to more than one handler");
+
+  static constexpr int32_t _lo = std::min({e2int(Handlers::id)...});
+  static constexpr int32_t _hi = std::max({e2int(Handlers::id)...});
+  static constexpr auto _table = detail::make_table<C, _lo, _hi - _lo + 1, Handlers...>();
+
+  static void _handler(void* self, esp_event_base_t, int32_t id, void* data){
+    uint32_t i = static_cast<uint32_t>(id - _lo);
+    if (i < _table.size() && _table[i]) _table[i](static_cast<C*>(self), data);
+  }
+
+public:
+  // event id dispatcher is registered with
+  static constexpr int32_t event_id = _lo == _hi ? _lo : ESP_EVENT_ANY_ID;
+
+  static esp_err_t subscribe(esp_event_base_t base, C* self, esp_event_handler_instance_t* instance){
+    return evt::subscribe(base, event_id, _handler, self, instance);
+  }
+
+  static esp_err_t unsubscribe(esp_event_base_t base, esp_event_handler_instance_t instance){
+    return evt::unsubscribe(base, event_id, instance);
+  }
+};
+
+/**
+ * @brief subscribe a single member function handler to event id
+ */
+template <iron_t Id, auto Fn, class C>
+esp_err_t subscribe(esp_event_base_t base, C* self, esp_event_handler_instance_t* instance){
+  return Dispatcher<C, on<Id, Fn>>::subscribe(base, self, instance);
+}
+
+} // namespace evt
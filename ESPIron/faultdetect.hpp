@@ -0,0 +1,140 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+
+/**
+ * Heater fault detection
+ * no Arduino/IDF dependencies, could be built for the host and run against thermalsim::TipPlant with injected faults
+ */
+namespace faults {
+
+enum class fault_t : uint32_t {
+  none = 0,
+  overtemp,           // tip temperature is above allowed maximum
+  open_heater,        // heater is powered, but temperature does not rise
+  stuck_on,           // heater is not powered, but temperature keeps rising (i.e. MOSFET shorted)
+  sensor_stuck        // temperature reading does not move while heater runs at full power
+};
+
+struct Params {
+  float t_max{480};             // over-temperature threshold, C
+  float t_open{500};            // readings above this are an open sensor, i.e. a removed tip, C
+  uint32_t overtemp_ms{1000};   // time temperature must stay above t_max to trigger a fault, ms
+  uint32_t window_ms{5000};     // observation window for open/stuck conditions, ms
+  float full_power{0.9f};       // output share of available max considered as heater running at full power
+  float open_rise{10};          // min temperature rise over a window at full power, C
+  float open_tmax{150};         // open heater is checked only below this temperature, C
+  float stuck_on_rise{15};      // max temperature rise over a window at zero power, C
+  float stuck_span{1.5f};       // temperature span over a window at full power considered as stuck sensor, C (~3 ADC LSB)
+};
+
+/**
+ * @brief heater fault detector
+ * fed with measured temperature and heater power share on each control tick, it checks power/temperature
+ * consistency over a fixed time window, cost per tick is a few comparisons.
+ * Detected fault is latched until reset
+ */
+class FaultDetector {
+  Params _p;
+  fault_t _fault{fault_t::none};
+
+  // window start time and temperature
+  uint32_t _w_start{0};
+  float _w_t0{0};
+  // temperature and power share extremes over a window
+  float _t_min{0}, _t_max{0}, _u_min{0}, _u_max{0};
+  bool _started{false};
+
+  // time temperature went above t_max, 0 if it is below
+  uint32_t _over_since{0};
+
+  void _window(uint32_t now, float t, float u){
+    _w_start = now;
+    _w_t0 = _t_min = _t_max = t;
+    _u_min = _u_max = u;
+    _started = true;
+  }
+
+public:
+  explicit FaultDetector(const Params& p = Params()) : _p(p) {}
+
+  const Params& params() const { return _p; }
+
+  // clear latched fault and observation window
+  void reset(){
+    _fault = fault_t::none;
+    _started = false;
+    _over_since = 0;
+  }
+
+  /**
+   * @brief restart observation window, i.e. when heater mode changes
+   */
+  void restart(){ _started = false; _over_since = 0; }
+
+  /**
+   * @brief check for faults
+   *
+   * @param now current time, ms
+   * @param t measured temperature, C, a reading above t_open is taken as a removed tip unless temperature was above t_max
+   * @param u heater output applied since previous step as a share of max output available, 0-1
+   *          i.e. PWM duty relative to power budget cap, so that full power is reachable on any supply
+   * @return fault_t latched fault, if any
+   */
+  fault_t step(uint32_t now, float t, float u){
+    if (_fault != fault_t::none) return _fault;
+
+    // a removed tip makes reading jump beyond any real temperature, such a reading is not an observation.
+    // Temperature that has been climbing above t_max already is a runaway that has passed open sensor level
+    if (t > _p.t_open){
+      if (_over_since) return _fault = fault_t::overtemp;
+      _started = false;
+      return _fault;
+    }
+
+    if (t > _p.t_max){
+      if (!_over_since) _over_since = now ? now : 1;
+      else if (now - _over_since >= _p.overtemp_ms) return _fault = fault_t::overtemp;
+    } else
+      _over_since = 0;
+
+    if (!_started){
+      _window(now, t, u);
+      return _fault;
+    }
+
+    if (t < _t_min) _t_min = t;
+    if (t > _t_max) _t_max = t;
+    if (u < _u_min) _u_min = u;
+    if (u > _u_max) _u_max = u;
+
+    if (now - _w_start < _p.window_ms) return _fault;
+
+    float rise = t - _w_t0;
+    if (_u_min >= _p.full_power && t < _p.open_tmax && rise < _p.open_rise)
+      _fault = fault_t::open_heater;
+    else if (_u_max == 0 && rise > _p.stuck_on_rise)
+      _fault = fault_t::stuck_on;
+    // a frozen OpAmp output still reads with ADC noise of a few LSB, so a span below that is not told apart from
+    // a live tip held steady at partial power. At full power a live tip moves well beyond it over a window
+    else if (_u_min >= _p.full_power && _t_max - _t_min < _p.stuck_span)
+      _fault = fault_t::sensor_stuck;
+
+    _window(now, t, u);
+    return _fault;
+  }
+
+  fault_t fault() const { return _fault; }
+};
+
+} // namespace faults
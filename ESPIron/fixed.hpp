@@ -0,0 +1,68 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+#include <type_traits>
+
+/**
+ * @brief signed Q-format fixed-point number stored in int32_t
+ * multiplication and division use 64 bit intermediates, results are truncated.
+ * No Arduino/IDF dependencies, could be built for the host as well
+ *
+ * @tparam F number of fractional bits
+ */
+template <int F>
+class Fixed {
+  static_assert(F > 0 && F < 31, "wrong number of fractional bits");
+  int32_t _v{0};
+
+  struct raw_t {};
+  constexpr Fixed(int32_t v, raw_t) : _v(v) {}
+
+public:
+  static constexpr int frac_bits = F;
+  static constexpr int32_t one = 1 << F;
+
+  constexpr Fixed() = default;
+  template <typename I, std::enable_if_t<std::is_integral<I>::value, int> = 0>
+  constexpr Fixed(I v) : _v(static_cast<int32_t>(v) * one) {}
+  explicit constexpr Fixed(float v) : _v(static_cast<int32_t>(v * one + (v < 0 ? -0.5f : 0.5f))) {}
+  explicit constexpr Fixed(double v) : _v(static_cast<int32_t>(v * one + (v < 0 ? -0.5 : 0.5))) {}
+
+  // make a number from raw Q-format value
+  static constexpr Fixed fromRaw(int32_t v){ return Fixed(v, raw_t()); }
+  constexpr int32_t raw() const { return _v; }
+
+  explicit constexpr operator int32_t() const { return _v >> F; }
+  explicit constexpr operator float() const { return static_cast<float>(_v) / one; }
+
+  constexpr Fixed operator-() const { return fromRaw(-_v); }
+  constexpr Fixed& operator+=(Fixed r){ _v += r._v; return *this; }
+  constexpr Fixed& operator-=(Fixed r){ _v -= r._v; return *this; }
+  constexpr Fixed& operator*=(Fixed r){ _v = static_cast<int32_t>((static_cast<int64_t>(_v) * r._v) >> F); return *this; }
+  constexpr Fixed& operator/=(Fixed r){ _v = static_cast<int32_t>((static_cast<int64_t>(_v) << F) / r._v); return *this; }
+
+  friend constexpr Fixed operator+(Fixed l, Fixed r){ return l += r; }
+  friend constexpr Fixed operator-(Fixed l, Fixed r){ return l -= r; }
+  friend constexpr Fixed operator*(Fixed l, Fixed r){ return l *= r; }
+  friend constexpr Fixed operator/(Fixed l, Fixed r){ return l /= r; }
+
+  friend constexpr bool operator==(Fixed l, Fixed r){ return l._v == r._v; }
+  friend constexpr bool operator!=(Fixed l, Fixed r){ return l._v != r._v; }
+  friend constexpr bool operator<(Fixed l, Fixed r){ return l._v < r._v; }
+  friend constexpr bool operator>(Fixed l, Fixed r){ return l._v > r._v; }
+  friend constexpr bool operator<=(Fixed l, Fixed r){ return l._v <= r._v; }
+  friend constexpr bool operator>=(Fixed l, Fixed r){ return l._v >= r._v; }
+};
+
+// Q16.16 number
+using q16_t = Fixed<16>;
@@ -1,10 +1,21 @@
 #include <array>
+#include <cstdio>
+#include <cstdlib>
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
 #include "const.h"
 #include "evtloop.hpp"
 #include "heater.hpp"
+#include "dsp.hpp"
+#include "nvs.hpp"
 #include "log.h"
 
+#ifdef HEATER_HW_TICK
+#define HEATER_TASK_PRIO          tskIDLE_PRIORITY+5    // task priority, above event loop and display tasks, below esp_timer task
+#else
 #define HEATER_TASK_PRIO          tskIDLE_PRIORITY+1    // task priority
+#endif
 #ifdef PTS200_DEBUG_LEVEL
 #define HEATER_TASK_STACK         2048                  // sprintf could take lot's of stack mem for debug messages
 #else
@@ -16,41 +27,115 @@
 #define HEATER_LEDC_DUTY_RES      HEATER_RES
 #define HEATER_LEDC_TIMER         LEDC_TIMER_0
 #define HEATER_LEDC_FREQUENCY     HEATER_FREQ
-#define HEATER_LEDC_RAMPUP_TIME   3000                  // time duration to fade in-for PWM ramping, ms
+#define HEATER_RAMP_TIME_MS       3000                  // soft-start power ramp duration, ms
+
+#define HEATER_OPAMP_STABILIZE_MS 8                     // time to wait after disabling PWM to let OpAmp stabilize, doubled while it's output keeps converging, ms
+#define HEATER_SETTLE_REPORT      256                   // report OpAmp settle time stats every this number of measurements
+#define HEATER_JITTER_REPORT      1024                  // report control tick jitter stats every this number of ticks
+#define HEATER_SYNC_BLANK_US      2000                  // initial OpAmp recovery time estimate in PWM-synced measurement mode, us
+#define HEATER_SYNC_MARGIN_US     300                   // timer dispatch and task switch margin for PWM-synced measurement, us
+#define HEATER_SYNC_RESYNC_MS     10000                 // PWM timer is restarted to refresh known phase at most this often, ms
+
+#define HEATER_ADC_SAMPLE_RATE    80000                 // ADC DMA sampling rate, Hz
+#define HEATER_ADC_TIMEOUT_MS     5                     // max time to wait for ADC DMA capture
+#define HEATER_ADC_TRIM           (HEATER_ADC_SAMPLES/4)  // number of lowest/highest ADC samples to drop before averaging
 
-#define HEATER_OPAMP_STABILIZE_MS 8                     // how long to wait after disabling PWM to let OpAmp stabilize
+#define HEATER_MV2C_K             0.5378f               // tip sense OpAmp mV to Celsius conversion, T = K * mV + B
+#define HEATER_MV2C_B             6.3959f
 
-#define HEATER_ADC_SAMPLES        8                     // number of ADC reads to averate tip tempearture
+#define HEATER_TUNE_HYSTERESIS    2                     // PID autotune relay hysteresis, C
+#define HEATER_TUNE_CYCLES        4                     // PID autotune oscillation periods to average
+#define HEATER_TUNE_TIMEOUT_MS    300000                // max PID autotune duration, ms
+#define HEATER_TUNE_OVERSHOOT_MAX 60                    // abort PID autotune if tip temperature exceeds target by this value, C
 
 #define PID_ENGAGE_DIFF_LOW       30                    // lower temperature difference when PID algo should be engaged
 #define PID_ENGAGE_DIFF_HIGH      10                    // higher temperature difference when PID algo should be engaged
 
 
-// normal interval between temp measurments
-constexpr TickType_t measure_delay_ticks = pdMS_TO_TICKS(1000 / HEATER_MEASURE_RATE);
 // long interval between temp measurments
 constexpr TickType_t long_measure_delay_ticks = pdMS_TO_TICKS(500);
 // idle interval between temp measurments
 constexpr TickType_t idle_delay_ticks = pdMS_TO_TICKS(1000);
+// interval between temp measurments while heater is off and tip is above max target temperature,
+// a runaway must be seen crossing fault threshold before it reaches no-tip level
+constexpr TickType_t hot_measure_delay_ticks = pdMS_TO_TICKS(1000 / HEATER_RATE_MID);
+// heater PWM period, us
+constexpr uint32_t pwm_period_us = 1000000 / HEATER_FREQ;
+// time it takes for ADC to capture a block of samples, us
+constexpr uint32_t adc_capture_us = HEATER_ADC_SAMPLES * 1000000 / HEATER_ADC_SAMPLE_RATE;
+// PID gains are stored for 8-bit duty and scaled by 2^shift, so that PID output follows PWM resolution
+constexpr int pid_shift = HEATER_RES - 8;
+static_assert(pid_shift >= 0, "PWM resolution must be at least 8 bits");
 
 // a simple constrain function
 template<typename T>
-T clamp(T value, T min, T max){
+constexpr T clamp(T value, T min, T max){
   return (value < min)? min : (value > max)? max : value;
 }
 
+// convert tip sense mV to Celsius
+template<typename T>
+constexpr T mv2celsius(uint32_t mv){
+  return clamp(T(HEATER_MV2C_K) * T(mv) + T(HEATER_MV2C_B), T(20), T(1000));
+}
+
+// exponential smoothing of tip temperature readings
+template<typename T>
+constexpr T smooth(T avg, T t){
+  return avg + (t - avg) * T(SMOOTHIE);
+}
+
+#ifdef HEATER_FIXED_POINT
+/**
+ * @brief check that fixed-point temperature path does not deviate from the float one
+ * all OpAmp output range is converted and a step response of smoothing is compared
+ */
+constexpr bool fixed_matches_float(float tolerance){
+  auto deviates = [tolerance](temp_t f, float v){ float d = static_cast<float>(f) - v; return d > tolerance || d < -tolerance; };
+  for (uint32_t mv = 0; mv <= 3300; ++mv)
+    if (deviates(mv2celsius<temp_t>(mv), mv2celsius<float>(mv))) return false;
+
+  temp_t avg(20);
+  float favg{20};
+  for (int i = 0; i != 100; ++i){
+    avg = smooth(avg, mv2celsius<temp_t>(700));
+    favg = smooth(favg, mv2celsius<float>(700));
+    if (deviates(avg, favg)) return false;
+  }
+  return true;
+}
+static_assert(fixed_matches_float(0.05f), "fixed-point temperature conversion deviates from float path");
+#endif
+
 TipHeater::~TipHeater(){
   // unsubscribe from event bus
   if (_evt_cmd_handler){
-    esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_SET_EVT, ESP_EVENT_ANY_ID, _evt_cmd_handler);
+    _cmd_table::unsubscribe(IRON_HEATER, _evt_cmd_handler);
     _evt_cmd_handler = nullptr;
   }
-/*
+
+  if (_tmr_sync){
+    esp_timer_stop(_tmr_sync);
+    esp_timer_delete(_tmr_sync);
+    _tmr_sync = nullptr;
+  }
+#ifdef HEATER_HW_TICK
+  if (_tick_tmr){
+    gptimer_stop(_tick_tmr);
+    gptimer_disable(_tick_tmr);
+    gptimer_del_timer(_tick_tmr);
+    _tick_tmr = nullptr;
+  }
+  if (_tick_sem){
+    vSemaphoreDelete(_tick_sem);
+    _tick_sem = nullptr;
+  }
+#endif
   if (_evt_ntf_handler){
-    esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_NOTIFY, ESP_EVENT_ANY_ID, _evt_ntf_handler);
+    _ntf_table::unsubscribe(IRON_NOTIFY, _evt_ntf_handler);
     _evt_ntf_handler = nullptr;
   }
-*/
+
   _stop_runner();
 }
 
@@ -58,76 +143,119 @@ void TipHeater::init(){
   // set PID output range
   _pid.setOutputRange(0, 1<<HEATER_RES);
 
-  // event bus subscriptions
-  if (!_evt_cmd_handler){
-    esp_event_handler_instance_register_with(
-      evt::get_hndlr(),
-      IRON_HEATER,
-      ESP_EVENT_ANY_ID,
-      [](void* self, esp_event_base_t base, int32_t id, void* data) { static_cast<TipHeater*>(self)->_evt_picker(base, id, data); },
-      this,
-      &_evt_cmd_handler
-    );
-  }
-/*
-  if (!_evt_ntf_handler){
-    esp_event_handler_instance_register_with(
-      evt::get_hndlr(),
-      IRON_NOTIFY,
-      ESP_EVENT_ANY_ID,
-      [](void* self, esp_event_base_t base, int32_t id, void* data) { static_cast<TipHeater*>(self)->_evt_picker(base, id, data); },
-      this,
-      &_evt_ntf_handler
-    );
-  }
-*/
-
-  // init HW fader
-  ledc_fade_func_install(0);
-  // create RTOS task that controls heater PWM
-  _start_runner();
-}
+  // bring up heater HAL (a thermal plant model in simulation builds)
+  hal::init();
 
-void TipHeater::_evt_picker(esp_event_base_t base, int32_t id, void* data){
+  // restore last used tip and it's profile
+  {
+    esp_err_t err;
+    std::unique_ptr<nvs::NVSHandle> handle = nvs::open_nvs_handle(T_Tips, NVS_READONLY, &err);
+    if (err == ESP_OK)
+      handle->get_item(T_tip, _tip);
+  }
+  _profile = _load_profile(_tip);
+  _lut.load(_profile.cal);
 
-  switch (static_cast<evt::iron_t>(id)){
-    case evt::iron_t::heaterTargetT : {
-      // change heater temp
-      setTargetTemp(*reinterpret_cast<int32_t*>(data));
-      return;
-    }
+  // tip sense ADC in DMA mode
+  if (_adc.init(TIP_ADC_SENSOR_PIN, HEATER_ADC_SAMPLES, HEATER_ADC_SAMPLE_RATE) != ESP_OK){
+    LOGE(T_HEAT, println, "Tip ADC init failed!");
+  }
 
-    case evt::iron_t::heaterEnable : {
-      // enable heater
-      enable();
-      return;
-    }
+#ifdef HEATER_PWM_SYNC
+  // timer that wakes heater task in PWM off-phase
+  if (!_tmr_sync){
+    const esp_timer_create_args_t tmr_args = {
+      .callback = [](void* self){ xTaskNotifyGive(static_cast<TipHeater*>(self)->_task_hndlr); },
+      .arg = this,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "htrSync",
+      .skip_unhandled_events = true
+    };
+    esp_timer_create(&tmr_args, &_tmr_sync);
+  }
+#endif
 
-    case evt::iron_t::heaterDisable : {
-      // disable heater in standby mode
-      disable();
-      return;
+#ifdef HEATER_HW_TICK
+  // hardware timer that triggers control ticks, heater task sets it's period
+  if (!_tick_tmr){
+    _tick_sem = xSemaphoreCreateBinary();
+    gptimer_config_t tmr_cfg = {
+      .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+      .direction = GPTIMER_COUNT_UP,
+      .resolution_hz = 1000000        // 1 us
+    };
+    gptimer_event_callbacks_t cbs = { .on_alarm = TipHeater::_cb_tick };
+    if (!_tick_sem || gptimer_new_timer(&tmr_cfg, &_tick_tmr) != ESP_OK ||
+        gptimer_register_event_callbacks(_tick_tmr, &cbs, this) != ESP_OK ||
+        gptimer_enable(_tick_tmr) != ESP_OK || gptimer_start(_tick_tmr) != ESP_OK){
+      LOGE(T_HEAT, println, "Control tick timer init failed, fallback to RTOS delay");
+      if (_tick_tmr){
+        gptimer_disable(_tick_tmr);
+        gptimer_del_timer(_tick_tmr);
+        _tick_tmr = nullptr;
+      }
     }
+  }
+#endif
 
-    case evt::iron_t::heaterRampUp : {
-      // disable heater in standby mode
-      rampUp();
-      return;
-    }
+  // event bus subscriptions
+  if (!_evt_cmd_handler)
+    _cmd_table::subscribe(IRON_HEATER, this, &_evt_cmd_handler);
+  if (!_evt_ntf_handler)
+    _ntf_table::subscribe(IRON_NOTIFY, this, &_evt_ntf_handler);
 
-/*
-    // obsolete, use deep-sleep in Suspend
-    case evt::iron_t::stateSuspend : {
-      // disable worker task in standby mode
-      _stop_runner();
-      return;
-    }
-*/
+  // heater might have missed power budget posted on controller init
+  evt::request<evt::iron_t::heaterPowerBudget>();
+
+  // create RTOS task that controls heater PWM
+  _start_runner();
+}
+
+void TipHeater::_ntf_tip_request(){
+  TipSelectReq sel{};
+  TipCalibrateReq cal{};
+  uint32_t sel_ver = _tip_select_box.read(sel);
+  uint32_t cal_ver = _tip_calibrate_box.read(cal);
+  bool do_sel = sel_ver != _tip_select_ver, do_cal = cal_ver != _tip_calibrate_ver;
+  _tip_select_ver = sel_ver;
+  _tip_calibrate_ver = cal_ver;
+  // calibration taken before tip selection belongs to previous tip
+  if (do_cal && (!do_sel || cal.seq < sel.seq)){
+    _ntf_tip_calibrate(cal.cal);
+    do_cal = false;
   }
+  if (do_sel)
+    _select_tip(sel.idx, _tip_r);
+  if (do_cal)
+    _ntf_tip_calibrate(cal.cal);
+}
+
+void TipHeater::_ntf_tip_calibrate(const calib::Curve& cal){
+  // update calibration in stored profile, so that other unsaved changes are not picked up
+  TipProfile p = _load_profile(_tip);
+  p.cal = cal;
+  // calibration points are taken at current chip temperature
+  p.tcj = _t_cj;
+  if (!calib::valid(p.cal)){
+    LOGW(T_HEAT, println, "invalid calibration curve");
+    return;
+  }
+  _save_profile(_tip, p);
+  _profile_box.publish(p);
+  LOGI(T_HEAT, printf, "tip:%u calibration updated, %u points\n", _tip, p.cal.n);
+}
+
+void TipHeater::_evt_power_budget(const evt::PowerBudget& b){
+  // heater task picks it up on next tick
+  _budget_mv = b.mv;
+  _budget_ma = b.ma;
+  LOGI(T_HEAT, printf, "power budget: %u mV, %u mA\n", b.mv, b.ma);
 }
 
 void TipHeater::setTargetTemp(int32_t t){
   _t.target = t;
+  // holding power learned at previous target is no good for a new one
+  _pid_preset = true;
   LOGD(T_HEAT, printf, "set target T:%d\n", _t.target);
 };
 
@@ -141,6 +269,8 @@ void TipHeater::_start_runner(){
       .clk_cfg          = LEDC_AUTO_CLK
   };
   ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
+  // PWM phase is unknown after timer reconfiguration
+  _pwm_origin = 0;
 
   // Prepare and then apply the LEDC PWM channel configuration
   ledc_channel_config_t ledc_channel = {
@@ -156,20 +286,15 @@ void TipHeater::_start_runner(){
   ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
 
   if (_task_hndlr) return;    // we are already running
-  xTaskCreatePinnedToCore(TipHeater::_runner,
+  if (xTaskCreatePinnedToCore(TipHeater::_runner,
                           HEATER_TASK_NAME,
                           HEATER_TASK_STACK,
                           (void *)this,
                           HEATER_TASK_PRIO,
                           &_task_hndlr,
-                          tskNO_AFFINITY ) == pdPASS;
-
-  // fader iterrupt handler, it will resume heaterControl task on fade end event
-  ledc_cbs_t fade_callback = { 
-    .fade_cb = TipHeater::_cb_ledc_fade_end_event
-  };
-  // register fader interrupt handler
-  ledc_cb_register(HEATER_LEDC_SPEEDMODE, _pwm.channel, &fade_callback, this);
+                          tskNO_AFFINITY ) != pdPASS){
+    LOGE(T_HEAT, println, "Heater task create failed!");
+  }
 }
 
 void TipHeater::_stop_runner(){
@@ -178,34 +303,56 @@ void TipHeater::_stop_runner(){
   if(_task_hndlr)
     vTaskDelete(_task_hndlr);
   _task_hndlr = nullptr;
-
-  // unregister cb interrupt handler
-  ledc_fade_func_uninstall();
 }
 
 void TipHeater::_heaterControl(){
   TickType_t xLastWakeTime = xTaskGetTickCount();
-  TickType_t delay_time = measure_delay_ticks;
+  TickType_t delay_time = pdMS_TO_TICKS(1000 / _rate);
   for (;;){
     // sleep to accomodate specified measuring rate
-    if ( xTaskDelayUntil( &xLastWakeTime, delay_time ) != pdTRUE ) continue;
+    if (!_wait_tick(xLastWakeTime, delay_time)) continue;
     // if task has not been delayed actually, than we can't keep up with desired measure rate, or thread was suspended from the outside
     // I can skip this measurment cycle
 
+    // notifications UI lane had no room for on previous ticks
+    _post_outbox();
+
+    // new tip profile has been loaded, apply it's PID gains
+    if (_profile_box.version() != _profile_ver){
+      _profile_ver = _profile_box.read(_profile);
+      _pid.reset();
+      _pid_preset = true;
+      _lut.load(_profile.cal);
+      // reference voltage and tip resistance might have changed
+      _ff_vin = UINT32_MAX;
+    }
+
+    // latest supply voltage for feed-forward and accelerometer die temperature for cold junction compensation
+    evt::latest::vin.read(_vin);
+    if (float t_cj; evt::latest::acceltemp.read(t_cj) && t_cj > HEATER_CJ_MIN && t_cj < HEATER_CJ_MAX)
+      _t_cj = t_cj;
+
+    // time when heater was switched off for measurement (0 if it was off already) and the time measurement must be done by
+    int64_t t_off{0}, deadline{0};
+
     switch (_state){
-      case HeaterState_t::notip :
       case HeaterState_t::inactive :
+        // MOSFET could be shorted while heater is inactive
+        delay_time = _t.calibrated > TEMP_MAX ? hot_measure_delay_ticks : idle_delay_ticks;
+        break;
+      case HeaterState_t::notip :
       case HeaterState_t::fault :
         delay_time = idle_delay_ticks;
         break;
       case HeaterState_t::active : {
-        // use while to avoid concurency issues with hw fader interrupt
-        while (ledc_get_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel)){
+#ifdef HEATER_PWM_SYNC
+        // try to catch a natural off-phase of PWM period, heater keeps running
+        if (_sync_offphase(t_off, deadline)) break;
+#endif
+        if (hal::pwm_get_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel)){
           // shut off heater in order to measure temperature 关闭加热器以测量温度
-          ledc_set_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, 0);
-          ledc_update_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel);
-          // idle while OpAmp stabilizes
-          vTaskDelay(pdMS_TO_TICKS(HEATER_OPAMP_STABILIZE_MS));
+          hal::pwm_off(HEATER_LEDC_SPEEDMODE, _pwm.channel, _pwm.invert);
+          t_off = esp_timer_get_time();
         }
         break;
       }
@@ -218,65 +365,176 @@ void TipHeater::_heaterControl(){
     }
 
     // measure tip temperature
-    auto t = _denoiseADC();
+    temp_t t{};
+    bool measured = _denoiseADC(t, t_off, deadline);
+
+    // OpAmp has not settled within PWM off-phase, shut off heater and measure again
+    if (!measured && deadline){
+      // PWM phase might have drifted, restart timer on next synced measurement
+      _pwm_origin = 0;
+      hal::pwm_off(HEATER_LEDC_SPEEDMODE, _pwm.channel, _pwm.invert);
+      t_off = esp_timer_get_time();
+      deadline = 0;
+      measured = _denoiseADC(t, t_off, deadline);
+    }
+    // heater has been held off since t_off, unless it was measured within PWM off-phase
+    _off_us = t_off && !deadline ? esp_timer_get_time() - t_off : 0;
+
+    // can't tell tip temperature, keep heater off until next cycle
+    if (!measured){
+      _pwm.duty = 0;
+      hal::pwm_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, 0);
+      continue;
+    }
+
+    // faulted heater stays off until power cycle, just keep reporting tip temperature
+    if (_state == HeaterState_t::fault){
+      _t.calibrated = static_cast<int32_t>(_calibrate(t));
+      evt::latest::tiptemp.publish(_t.calibrated);
+      continue;
+    }
+
+    // heater must be checked in any state, MOSFET could be shorted while heater is inactive.
+    // It goes before tip checks, a runaway reads beyond no-tip level as well, detector tells it apart from a removed tip
+    if (_check_faults(t)) continue;
 
     // check if we've lost the Tip
-    if (_state != HeaterState_t::notip && t > TEMP_NOTIP){
+    if (_state != HeaterState_t::notip && t > temp_t(TEMP_NOTIP)){
       // we have just lost connection with a tip sensor
       // disable PWM
-      ledc_set_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, 0);
-      ledc_update_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel);
+      _pwm.duty = 0;
+      hal::pwm_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, 0);
       _state = HeaterState_t::notip;
+      _faults.restart();
+      _autotune_abort();
+      _ramp_end();
+      _pid_inband = false;
       LOGW(T_HEAT, printf, "Iron Tip ejected, T:%d\n", static_cast<int32_t>(t));
-      EVT_POST(SENSOR_DATA, e2int(evt::iron_t::tipEject));
+      evt::post<evt::iron_t::tipEject>(SENSOR_DATA);
       continue;
     }
 
     // check if we've get the Tip back
-    if (_state == HeaterState_t::notip && t < TEMP_NOTIP){
+    if (_state == HeaterState_t::notip && t < temp_t(TEMP_NOTIP)){
       _state = HeaterState_t::active;
-      EVT_POST(SENSOR_DATA, e2int(evt::iron_t::tipInsert));
+      // new tip might have different OpAmp settle behaviour
+      _settle.reset();
+      _recovery.reset();
+      _estimate_reset(t);
+      _faults.restart();
+      _pid_preset = true;
+      _rmeas = true;
+      _rmeas_mohm = 0;
+      // resistance of removed tip is stale
+      _outbox.resistance = false;
+      evt::post<evt::iron_t::tipInsert>(SENSOR_DATA);
       LOGW(T_HEAT, println, "Iron Tip inserted");
       continue;
     }
 
+    // heater stays off until tip is back, reading is reported as is
+    if (_state == HeaterState_t::notip){
+      _t.calibrated = static_cast<int32_t>(_calibrate(t));
+      evt::latest::tiptemp.publish(_t.calibrated);
+      continue;
+    }
+
+    // identify newly inserted tip by heater resistance, a pulse is fired only when heater is enabled
+    if (_rmeas && _state == HeaterState_t::active){
+      _rmeas = false;
+      // pulse is capped with current supply budget
+      _update_feedforward();
+      _rmeas_mohm = _measure_resistance();
+      // power budget cap is recalculated for measured resistance
+      _ff_vin = UINT32_MAX;
+      if (uint32_t r = _rmeas_mohm){
+        LOGI(T_HEAT, printf, "tip resistance: %u mOhm\n", r);
+        // tip profile is selected on it, must not be dropped
+        _outbox.resistance = true;
+        _post_outbox();
+      }
+    }
+
     // if heater is inactive, just reset avg temperature readings and suspend
     if (_state == HeaterState_t::inactive){
-      //_t.calibrated = calculateTemp(t);
-      _t.calibrated = t;
-      _t.avg = t;
-      EVT_POST_DATA(SENSOR_DATA, e2int(evt::iron_t::tiptemp), &_t.calibrated, sizeof(_t.calibrated));
+      _autotune_abort();
+      _ramp_end();
+      _pid_inband = false;
+      _t.calibrated = static_cast<int32_t>(_calibrate(t));
+      _estimate_reset(t);
+      evt::latest::tiptemp.publish(_t.calibrated);
       continue;
     }
 
-    // TODO: check for fault-overheating here
-
     // OK, now we are in active state for sure
 
+    // soft-start has been requested, it is taken only in active state, so an inactive tick can't drop it
+    if (_ramp_req.exchange(false))
+      _ramp_start = esp_timer_get_time();
+
+    int32_t t_prev = _t.calibrated;
     // read tip temperature and average it with previous readings
-    _t.avg += (t - _t.avg) * SMOOTHIE;  // stabilize ADC temperature reading 稳定ADC温度读数
-    // calibrate temp based on map table
-    // note: this is ugly external function, I will rework it later
-    //_t.calibrated = calculateTemp(_t.avg);
-    _t.calibrated = _t.avg;
-    ADC_LOGV(T_ADC, printf, "avg T: %5.1f, cal T: %d, tgt T:%d\n", _t.avg, _t.calibrated, _t.target);
-    EVT_POST_DATA(SENSOR_DATA, e2int(evt::iron_t::tiptemp), &_t.calibrated, sizeof(_t.calibrated));
+#ifdef HEATER_TEMP_ESTIMATOR
+    _estimate(t);
+#else
+    _t.avg = smooth(_t.avg, t);  // stabilize ADC temperature reading 稳定ADC温度读数
+#endif
+    // calibrate temp based on tip's LUT
+    _t.precise = _calibrate(_t.avg);
+    _t.calibrated = static_cast<int32_t>(_t.precise);
+#ifndef HEATER_TEMP_ESTIMATOR
+    // finite difference of integer temperature is noisy, smooth it same way as readings
+    _t.rate = smooth(_t.rate, static_cast<float>(_t.calibrated - t_prev) * configTICK_RATE_HZ / delay_time);
+#endif
+    ADC_LOGV(T_ADC, printf, "avg T: %5.1f, rate: %5.1f C/s, cal T: %d, tgt T:%d\n", static_cast<float>(_t.avg), _t.rate, _t.calibrated, _t.target);
+    evt::latest::tiptemp.publish(_t.calibrated);
+
+    // supply voltage or power budget might have changed
+    _update_feedforward();
+
+    // relay test replaces normal control while autotune is running
+    if (_tune_req.exchange(false))
+      _autotune_start();
+    if (_tuner.running()){
+      _pid_inband = false;
+      _autotune_step();
+      delay_time = pdMS_TO_TICKS(1000 / HEATER_RATE_MID);
+      _pwm_apply(delay_time);
+      continue;
+    }
 
     // if PID algo should be engaged
     if (_t.calibrated > (_t.target - PID_ENGAGE_DIFF_LOW) && _t.calibrated < (_t.target + PID_ENGAGE_DIFF_HIGH)){
-      _pwm.duty = _pid.step(_t.target, _t.calibrated);
-      delay_time = measure_delay_ticks;
+      // target band is reached, PID takes over from soft-start
+      _ramp_end();
+      uint32_t boost = _load_boost(t_prev);
+      // error diffusion, duty fraction lost to quantization is added on next tick, so average duty is exact
+      // output is clamped while in float, conversion of a value beyond uint32 range is undefined
+      float d = (_pid_step() + boost) * _ff_k;
+      float d_max = static_cast<float>(_duty_max) * 65536;
+      uint32_t duty = static_cast<uint32_t>(d < d_max ? d : d_max) + _dither;
+      _dither = duty & 0xffff;
+      _pwm.duty = duty >> 16;
+      if (_pwm.duty > _duty_max) _pwm.duty = _duty_max;
+      delay_time = _schedule_rate();
     } else {
       // heater must be either turned full on or off
-      _pwm.duty = _t.calibrated < _t.target ? 1<<HEATER_RES : 0;
-      _pid.clear();   // reset pid algo
-      // give heater more time to gain/loose temperature
-      delay_time = long_measure_delay_ticks;
+      _pwm.duty = _t.calibrated < _t.target ? _duty_max : 0;
+      // integrator is kept, PID resumes with the power it has learned
+      _pid_inband = false;
+      _stable_ticks = 0;
+      _boost = 0;
+      // give heater more time to gain/loose temperature, unless it is too hot already
+      delay_time = _pwm.duty || _t.calibrated <= TEMP_MAX ? long_measure_delay_ticks : hot_measure_delay_ticks;
     }
 
-    ledc_set_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel,  _pwm.duty);
-    ledc_update_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel);
-    PWM_LOGV(T_HEAT, printf, "Duty:%u\n",  _pwm.duty);
+    // soft-start limits heater power until target band is reached, keep sampling often meanwhile
+    if (_ramp_start){
+      _pwm.duty = _ramp_duty(_pwm.duty);
+      delay_time = pdMS_TO_TICKS(1000 / HEATER_RATE_MID);
+    }
+
+    _pwm_apply(delay_time);
   }
   // Task must self-terminate (if ever)
   vTaskDelete(NULL);
@@ -305,87 +563,648 @@ void TipHeater::enable(){
 void TipHeater::disable(){
   switch (_state){
     case HeaterState_t::active :
-      ledc_set_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, 0);
-      ledc_update_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel);
+      _pwm.duty = 0;
+      hal::pwm_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, 0);
+      // a ramp request not yet taken by heater task must not carry over to next enable()
+      _ramp_req = false;
       _state = HeaterState_t::inactive;
       LOGI(T_PWM, println, "Disable");
       break;
     // in all other cases this call could be ignored
+    default:
+      break;
   }
 }
 
 void TipHeater::rampUp(){
   // can only ramp-up from inactive state
-  if (_state != HeaterState_t::inactive) return;
+  portENTER_CRITICAL(&_ramp_mux);
+  bool inactive = _state == HeaterState_t::inactive;
+  if (inactive){
+    _ramp_req = true;
+    _state = HeaterState_t::active;
+  }
+  portEXIT_CRITICAL(&_ramp_mux);
+  if (!inactive) return;
+  LOGI(T_HEAT, printf, "Ramp-up, target T:%d\n", _t.target);
+}
+
+uint32_t TipHeater::_ramp_duty(uint32_t duty){
+  uint32_t elapsed = (esp_timer_get_time() - _ramp_start) / 1000;
+  if (elapsed >= HEATER_RAMP_TIME_MS){
+    _ramp_end();
+    return duty;
+  }
 
-  // first suspend heaterControl task for the duration of fade-in, 'cause no changes to PWM duty could be made for that period,
-  // fader interrupt will resume it
-  vTaskSuspend( _task_hndlr );
-  // initiate HW fader
-  ledc_set_fade_time_and_start(HEATER_LEDC_SPEEDMODE, _pwm.channel, 1<<HEATER_RES, HEATER_LEDC_RAMPUP_TIME, LEDC_FADE_NO_WAIT);
-  // from now on consider heater in active state
-  _state = HeaterState_t::active;
+  float x = static_cast<float>(elapsed) / HEATER_RAMP_TIME_MS;
+#ifdef HEATER_RAMP_SCURVE
+  // smoothstep, soft at both ends
+  x = x * x * (3 - 2 * x);
+#endif
+  // power budget cap still applies, so it's a current-limited ramp as well
+  uint32_t cap = static_cast<uint32_t>(x * _duty_max);
+  return duty < cap ? duty : cap;
+}
+
+void TipHeater::_ramp_end(){
+  if (!_ramp_start) return;
+  _ramp_start = 0;
+  _outbox.ramp_cmplt = true;
+  _post_outbox();
 }
 
-bool TipHeater::_cb_ledc_fade_end_event(const ledc_cb_param_t *param, void *arg){
-  // do not care what was the event, I need to unblock heater control anyway
-  // if (param->event == LEDC_FADE_END_EVT)
+TickType_t TipHeater::_schedule_rate(){
+  uint32_t rate = _rate;
+  if (_t.rate < -HEATER_LOAD_SLOPE || _boost){
+    // tip is loosing heat fast, i.e. soldering a massive ground plane
+    rate = HEATER_RATE_HIGH;
+    _stable_ticks = 0;
+  } else if (std::abs(_t.target - _t.calibrated) > HEATER_RATE_STABLE_BAND){
+    if (rate < HEATER_RATE_MID) rate = HEATER_RATE_MID;
+    _stable_ticks = 0;
+  } else if (++_stable_ticks >= HEATER_RATE_STABLE_MS * _rate / 1000){
+    // temperature is stable, back off one step
+    rate = rate > HEATER_RATE_MID ? HEATER_RATE_MID : HEATER_MEASURE_RATE;
+    _stable_ticks = 0;
+  }
+
+  // saturated heater can't make up for measurement off-time, measuring more often only takes power away
+  if (_pwm.duty >= _duty_max && _off_us){
+    uint32_t hz = 10000 * HEATER_OFF_SHARE_MAX / _off_us;
+    if (hz < HEATER_MEASURE_RATE) hz = HEATER_MEASURE_RATE;
+    if (rate > hz) rate = hz;
+  }
+
+  _set_rate(rate);
+  return pdMS_TO_TICKS(1000 / _rate);
+}
+
+uint32_t TipHeater::_load_boost(int32_t t_prev){
+  int64_t now = esp_timer_get_time();
+  if (!_boost && _t.rate < -HEATER_LOAD_SLOPE && std::abs(_t.target - t_prev) <= HEATER_LOAD_BAND && _pwm.duty < _duty_max){
+    // power share that would compensate for the heat drain
+    float share = -_t.rate / _est.params().heat_rate;
+    _boost = share > 1 ? 1<<HEATER_RES : static_cast<uint32_t>(share * (1<<HEATER_RES));
+    _boost_end = now + HEATER_LOAD_BOOST_MS * 1000;
+    CTRL_LOGV(T_HEAT, printf, "thermal load: %5.1f C/s, boost duty:%u\n", _t.rate, _boost);
+    float rate = _t.rate;
+    // informational, dropped if UI lane is busy
+    evt::post<evt::iron_t::heaterLoad>(evt::post_policy_t::nowait, IRON_NOTIFY, rate);
+  }
+
+  if (!_boost) return 0;
+  if (now >= _boost_end) return _boost = 0;
+  return static_cast<uint32_t>(_boost * (_boost_end - now) / (HEATER_LOAD_BOOST_MS * 1000));
+}
+
+void TipHeater::_set_rate(uint32_t hz){
+  if (hz == _rate) return;
+  CTRL_LOGV(T_HEAT, printf, "control rate: %u Hz\n", hz);
+  // PID takes actual time between steps, nothing to rescale
+  _rate = hz;
+}
+
+float TipHeater::_pid_step(){
+  int64_t now = esp_timer_get_time();
+  float sp = static_cast<float>(_t.target);
+
+  pid::Gains<float> g = _profile.pid.at(sp);
+  constexpr float scale = 1 << pid_shift;
+  _pid.setGains({temp_t(g.kp * scale), temp_t(g.ki * scale), temp_t(g.kd * scale)});
+
+  // time spent in bang-bang mode must not be integrated, take a nominal period on engagement
+  float dt = _pid_inband ? static_cast<float>(now - _t_pid) * 1e-6f : 1.0f / _rate;
+  _t_pid = now;
+
+  if (!_pid_inband && _pid_preset.exchange(false)){
+    // power share that holds tip at target against heat loss, as per tip's thermal model
+    const auto &m = _est.params();
+    float hold = m.loss * (sp - m.t_amb) / m.heat_rate;
+    hold = hold < 0 ? 0 : hold * (1<<HEATER_RES);
+    // integrator takes holding power, measurement is taken as is, so that engagement below target does not kick derivative
+    _pid.preset(temp_t(hold), _t.precise);
+    CTRL_LOGV(T_HEAT, printf, "PID engaged, T:%5.1f, holding duty:%5.0f\n", static_cast<float>(_t.precise), hold);
+  }
+  _pid_inband = true;
+
+  return static_cast<float>(_pid.step(temp_t(sp), _t.precise, temp_t(dt)));
+}
 
+void TipHeater::_estimate(temp_t t){
+  int64_t now = esp_timer_get_time();
+  float dt = static_cast<float>(now - _t_est) * 1e-6f;
+  _t_est = now;
+
+  _est.predict(dt, _power_share());
+  _est.update(static_cast<float>(t));
+  _t.avg = temp_t(_est.temp());
+  _t.rate = _est.rate();
+}
+
+float TipHeater::_power_share() const {
+  // heater switched off since the last duty has been applied has delivered nothing
+  float u = _pwm.duty ? static_cast<float>(_duty_avg) / (1<<HEATER_RES) : 0;
+  uint32_t vin = _vin;
+  if (vin >= HEATER_FF_VIN_MIN)
+    u *= static_cast<float>(vin) * vin / (static_cast<float>(_profile.vref) * _profile.vref);
+  return u;
+}
+
+void TipHeater::_pwm_apply(TickType_t period){
+  uint32_t duty = _pwm.duty;
+  _duty_avg = duty;
+  if (duty && _off_us){
+    // heater is on for the rest of period only, next measurement window is expected to take as long as this one
+    uint32_t period_us = period * portTICK_PERIOD_MS * 1000;
+    uint32_t on_us = period_us > _off_us ? period_us - _off_us : 0;
+    uint64_t d = on_us ? static_cast<uint64_t>(duty) * period_us / on_us : _duty_max;
+    duty = d < _duty_max ? d : _duty_max;
+    _duty_avg = static_cast<uint64_t>(duty) * on_us / period_us;
+  }
+  hal::pwm_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, duty);
+  PWM_LOGV(T_HEAT, printf, "Duty:%u, applied:%u, off:%u us\n", _pwm.duty, duty, _off_us);
+}
+
+bool TipHeater::_check_faults(temp_t t){
+  // fractional calibrated temperature, frozen sensor is told apart from a stable one by ADC noise
+  float tc = static_cast<float>(_calibrate(t));
+  // output relative to budget cap, full available power is below full duty on a power limited supply
+  float u = _duty_max ? static_cast<float>(_pwm.duty) / _duty_max : 0;
+  faults::fault_t f = _faults.step(esp_timer_get_time() / 1000, tc, u);
+  if (f == faults::fault_t::none) return false;
+
+  _pwm.duty = 0;
+  hal::pwm_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, 0);
+  _state = HeaterState_t::fault;
+  _autotune_abort();
+  _ramp_end();
+  LOGE(T_HEAT, printf, "Heater fault:%u, T:%5.1f, heater is shut off\n", e2int(f), tc);
+  _outbox.fault = true;
+  _post_outbox();
+  return true;
+}
+
+temp_t TipHeater::_calibrate(temp_t t) const {
+  return _lut.map(t + temp_t(_t_cj - _profile.tcj));
+}
+
+void TipHeater::_estimate_reset(temp_t t){
+  _t.avg = t;
+  _t.rate = 0;
+  _est.reset(static_cast<float>(t));
+  _t_est = esp_timer_get_time();
+}
+
+void TipHeater::_update_feedforward(){
+  uint32_t vin = _vin, mv = _budget_mv, ma = _budget_ma;
+  // measured tip resistance is scaled by supply path resistance estimate, it may only tighten the cap
+  uint32_t r = _rmeas_mohm ? _rmeas_mohm : _profile.r_mohm;
+  if (!r || r > HEATER_TIP_R_MOHM) r = HEATER_TIP_R_MOHM;
+  if (vin == _ff_vin && mv == _cap_mv && ma == _cap_ma && r == _cap_r) return;
+  bool cap_changed = mv != _cap_mv || ma != _cap_ma || r != _cap_r;
+  _ff_vin = vin;
+  _cap_mv = mv;
+  _cap_ma = ma;
+  _cap_r = r;
+
+  if (vin < HEATER_FF_VIN_MIN){
+    _ff_k = 1<<16;
+  } else {
+    uint64_t vref = _profile.vref;
+    _ff_k = (vref * vref << 16) / (static_cast<uint64_t>(vin) * vin);
+  }
+
+  // PID output range is in units of power at reference voltage, it's max matches full duty at current Vin,
+  // so that integral term does not wind up when duty is saturated on a low voltage supply
+  uint32_t v = vin > mv ? vin : mv;
+  _duty_max = 1<<HEATER_RES;
+  if (ma && v){
+    uint64_t dmax = (static_cast<uint64_t>(ma) * r << HEATER_RES) / (static_cast<uint64_t>(v) * 1000);
+    if (dmax < _duty_max) _duty_max = dmax;
+    // duty cap limits average current, pulse current is not limited
+    if (cap_changed && static_cast<uint64_t>(v) * 1000 > static_cast<uint64_t>(ma) * r){
+      LOGI(T_HEAT, printf, "heater pulse current %u mA is above %u mA budget, only average current is capped\n", static_cast<uint32_t>(static_cast<uint64_t>(v) * 1000 / r), ma);
+    }
+  }
+
+  _pid.setOutputRange(0, temp_t(static_cast<float>(_duty_max) * 65536 / _ff_k));
+  CTRL_LOGV(T_HEAT, printf, "Vin:%u mV, feed-forward k:%u/65536, budget:%u mV %u mA, max duty:%u\n", vin, _ff_k, mv, ma, _duty_max);
+}
+
+TipProfile TipHeater::_load_profile(uint32_t idx){
+  TipProfile p;
+  char key[8];
+  std::snprintf(key, sizeof(key), "%s%u", T_tip, idx);
+  if (nvs_blob_read(T_Tips, key, &p, sizeof(p)) != ESP_OK || p.version != TIP_PROFILE_VERSION){
+    LOGI(T_HEAT, printf, "no valid profile for tip:%u, using defaults\n", idx);
+    return TipProfile();
+  }
+  for (size_t i = 0; i != p.pid.n; ++i){
+    LOGD(T_HEAT, printf, "tip:%u PID T:%.0f Kp:%.2f Ki:%.3f Kd:%.2f\n", idx, p.pid.p[i].sp, p.pid.p[i].g.kp, p.pid.p[i].g.ki, p.pid.p[i].g.kd);
+  }
+  return p;
+}
+
+esp_err_t TipHeater::_save_profile(uint32_t idx, const TipProfile& p){
+  char key[8];
+  std::snprintf(key, sizeof(key), "%s%u", T_tip, idx);
+  return nvs_blob_write(T_Tips, key, &p, sizeof(p));
+}
+
+void TipHeater::_select_tip(uint32_t idx, uint32_t r_mohm){
+  _tip = idx % TIPMAX;
+  esp_err_t err;
+  std::unique_ptr<nvs::NVSHandle> handle = nvs::open_nvs_handle(T_Tips, NVS_READWRITE, &err);
+  if (err == ESP_OK)
+    handle->set_item(T_tip, _tip);
+
+  TipProfile p = _load_profile(_tip);
+  if (r_mohm && p.r_mohm != r_mohm){
+    p.r_mohm = r_mohm;
+    _save_profile(_tip, p);
+    LOGI(T_HEAT, printf, "tip:%u resistance %u mOhm learned\n", _tip, r_mohm);
+  }
+  _profile_box.publish(p);
+  LOGI(T_HEAT, printf, "select tip:%u\n", _tip);
+}
+
+uint32_t TipHeater::_read_vin(){
+  uint32_t v{0}, cnt{0};
+  for (uint32_t i = 0; i != HEATER_RMEAS_SAMPLES; ++i){
+    // ADC unit could be locked by tip sensor DMA capture, such reads return 0 and should be skipped
+    if (uint32_t mv = hal::adc_mv(VIN_PIN)){
+      v += mv;
+      ++cnt;
+    }
+  }
+  return cnt ? v / cnt * VIN_DIVIDER : 0;
+}
+
+uint32_t TipHeater::_measure_resistance(){
+  int64_t t0 = esp_timer_get_time();
+  uint32_t v_open = _read_vin();
+  uint32_t read_us = esp_timer_get_time() - t0;
+  // pulse duty is capped with power budget same as heating, Vin under load must be read within a single PWM pulse
+  uint32_t t_on = static_cast<uint64_t>(pwm_period_us) * _duty_max >> HEATER_RES;
+  if (t_on < HEATER_RMEAS_PULSE_US + 2 * read_us){
+    LOGD(T_HEAT, printf, "power budget is too tight for tip resistance pulse, max duty:%u\n", _duty_max);
+    return 0;
+  }
+  // new duty is latched at the start of a PWM period, restart the timer to get the pulse right now
+  hal::pwm_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel, _duty_max);
+  hal::pwm_restart(HEATER_LEDC_SPEEDMODE, HEATER_LEDC_TIMER);
+  esp_rom_delay_us(HEATER_RMEAS_PULSE_US);
+  uint32_t v_load = _read_vin();
+  hal::pwm_off(HEATER_LEDC_SPEEDMODE, _pwm.channel, _pwm.invert);
+  // PWM phase is lost
+  _pwm_origin = 0;
+
+  if (!v_open || !v_load || v_open < v_load + HEATER_RMEAS_DROOP_MIN){
+    LOGD(T_HEAT, printf, "can't measure tip resistance, Vopen:%u mV, Vload:%u mV\n", v_open, v_load);
+    return 0;
+  }
+  return static_cast<uint64_t>(HEATER_SUPPLY_R_MOHM) * v_load / (v_open - v_load);
+}
+
+void TipHeater::_match_tip(uint32_t r){
+  _tip_r = r;
+  uint32_t best{TIPMAX}, best_d{UINT32_MAX}, matches{0};
+  bool current_known{false};
+
+  for (uint32_t i = 0; i != TIPMAX; ++i){
+    // read blobs directly, missing profiles are not worth logging here
+    TipProfile p;
+    char key[8];
+    std::snprintf(key, sizeof(key), "%s%u", T_tip, i);
+    if (nvs_blob_read(T_Tips, key, &p, sizeof(p)) != ESP_OK || p.version != TIP_PROFILE_VERSION || !p.r_mohm) continue;
+    if (i == _tip) current_known = true;
+
+    uint32_t d = r > p.r_mohm ? r - p.r_mohm : p.r_mohm - r;
+    if (d * 100 > p.r_mohm * HEATER_TIP_R_TOLERANCE) continue;
+    // current tip matches, keep it
+    if (i == _tip) return;
+    ++matches;
+    if (d < best_d){
+      best = i;
+      best_d = d;
+    }
+  }
+
+  if (matches == 1){
+    LOGI(T_HEAT, printf, "tip:%u matched by resistance %u mOhm\n", best, r);
+    _select_tip(best);
+    return;
+  }
+
+  if (matches){
+    LOGI(T_HEAT, printf, "%u tips match resistance %u mOhm, select tip manually\n", matches, r);
+    return;
+  }
+
+  // first time this tip is measured, remember it
+  if (!current_known){
+    _select_tip(_tip, r);
+    return;
+  }
+
+  LOGI(T_HEAT, printf, "unknown tip, resistance %u mOhm, select tip manually\n", r);
+}
+
+void TipHeater::_autotune_start(){
+  autotune::RelayTuner::Params p;
+  p.setpoint = _t.target;
+  p.hysteresis = HEATER_TUNE_HYSTERESIS;
+  p.out_high = _duty_max;
+  p.out_low = 0;
+  p.cycles = HEATER_TUNE_CYCLES;
+  p.timeout_ms = HEATER_TUNE_TIMEOUT_MS;
+  p.t_max = _t.target + HEATER_TUNE_OVERSHOOT_MAX;
+  _tuner.start(p, esp_timer_get_time() / 1000);
+  // relay test drives heater power on it's own
+  _ramp_end();
+  LOGI(T_HEAT, printf, "PID autotune started, T:%d\n", _t.target);
+}
+
+void TipHeater::_autotune_step(){
+  // setpoint and overshoot limit are calibrated temperatures, so is the reading PID will run on with resulting gains
+  _pwm.duty = _tuner.step(esp_timer_get_time() / 1000, static_cast<float>(_t.precise));
+
+  switch (_tuner.state()){
+    case autotune::RelayTuner::state_t::running :
+      return;
+
+    case autotune::RelayTuner::state_t::done : {
+      // relay output is in full-resolution duty, PID gains are stored for 8-bit duty
+      auto g = _tuner.gains();
+      pid::Gains<float> pg{g.kp / (1 << pid_shift), g.ki / (1 << pid_shift), g.kd / (1 << pid_shift)};
+      // gains are valid around the temperature the test was run at, other schedule points are kept
+      _profile.pid.set(_t.target, pg, HEATER_PID_SCHEDULE_MERGE);
+      // gains are valid for the voltage the test was run at
+      _profile.vref = _vin >= HEATER_FF_VIN_MIN ? _vin : HEATER_VIN_REF_MV;
+      _ff_vin = UINT32_MAX;
+      _pid.reset();
+      _pid_preset = true;
+      LOGI(T_HEAT, printf, "PID autotune T:%d Ku:%.2f Pu:%.2f s, Kp:%.2f Ki:%.3f Kd:%.2f\n", _t.target, _tuner.ultimateGain(), _tuner.ultimatePeriod(), pg.kp, pg.ki, pg.kd);
+      // new gains are saved on it, must not be dropped
+      _tuned = _profile;
+      _outbox.tuned = true;
+      _post_outbox();
+      return;
+    }
+
+    default :
+      LOGW(T_HEAT, println, "PID autotune failed");
+      _outbox.tune_fail = true;
+      _post_outbox();
+  }
+}
+
+void TipHeater::_autotune_abort(){
+  // drop pending request, autotune could be started only when heater is active
+  _tune_req = false;
+  if (!_tuner.running()) return;
+  _tuner.abort();
+  LOGW(T_HEAT, println, "PID autotune aborted");
+  _outbox.tune_fail = true;
+  _post_outbox();
+}
+
+void TipHeater::_post_outbox(){
+  using evt::post_policy_t;
+  if (_outbox.fault && evt::post<evt::iron_t::heaterFault>(post_policy_t::nowait, IRON_NOTIFY, _faults.fault()) == ESP_OK)
+    _outbox.fault = false;
+  if (_outbox.resistance && evt::post<evt::iron_t::tipResistance>(post_policy_t::nowait, IRON_NOTIFY, _rmeas_mohm) == ESP_OK)
+    _outbox.resistance = false;
+  if (_outbox.tuned && evt::post<evt::iron_t::autotuneCmplt>(post_policy_t::nowait, IRON_NOTIFY, _tuned) == ESP_OK)
+    _outbox.tuned = false;
+  if (_outbox.tune_fail && evt::post<evt::iron_t::autotuneFail>(post_policy_t::nowait, IRON_NOTIFY) == ESP_OK)
+    _outbox.tune_fail = false;
+  if (_outbox.ramp_cmplt && evt::post<evt::iron_t::statePWRRampCmplt>(post_policy_t::nowait, IRON_NOTIFY) == ESP_OK)
+    _outbox.ramp_cmplt = false;
+  if (_tip_kick.exchange(false))
+    _kick_tip_request();
+}
+
+void TipHeater::_kick_tip_request(){
+  // extra kicks are harmless, UI lane handles only commands it has not seen yet
+  if (evt::post<evt::iron_t::tipRequest>(evt::post_policy_t::nowait, IRON_NOTIFY) != ESP_OK)
+    _tip_kick = true;
+}
+
+#ifdef HEATER_PWM_SYNC
+bool TipHeater::_sync_offphase(int64_t &t_off, int64_t &deadline){
+  uint32_t duty = hal::pwm_get_duty(HEATER_LEDC_SPEEDMODE, _pwm.channel);
+  // heater is already off, nothing to wait for
+  if (!duty) return true;
+  // PWM output is continuous at full duty, there is no off-phase to catch
+  if (duty >= 1<<HEATER_RES || !_tmr_sync) return false;
+
+  // PWM pulse starts at the beginning of a period (hpoint = 0), the rest of the period is the off-phase
+  uint32_t t_on = static_cast<uint64_t>(pwm_period_us) * duty >> HEATER_RES;
+  // settle time is the start of a window of up to three blocks OpAmp reading is taken from, start capturing there
+  uint32_t blank = _settle.percentile(90, HEATER_SYNC_BLANK_US);
+  // otherwise heater is switched off at the falling edge, OpAmp recovery starts within off-phase anyway
+  bool fits = pwm_period_us - t_on >= blank + 3 * adc_capture_us + HEATER_SYNC_MARGIN_US;
+
+  // PWM timer keeps it's phase, it is restarted only when phase is unknown or is due for a refresh,
+  // each restart cuts PWM period in progress short
+  int64_t now = esp_timer_get_time();
+  if (!_pwm_origin || now - _pwm_origin > HEATER_SYNC_RESYNC_MS * 1000){
+    hal::pwm_restart(HEATER_LEDC_SPEEDMODE, HEATER_LEDC_TIMER);
+    _pwm_origin = now = esp_timer_get_time();
+  }
+
+  int64_t origin = now - (now - _pwm_origin) % pwm_period_us;
+  if (!fits && now >= origin + t_on){
+    // off-phase of current period is in progress, OpAmp has been recovering since the falling edge
+    hal::pwm_off(HEATER_LEDC_SPEEDMODE, _pwm.channel, _pwm.invert);
+    t_off = origin + t_on;
+    deadline = 0;
+    return true;
+  }
+
+  // sleep until the end of OpAmp blanking in current period, or the next one if it's too late for current
+  if (fits && origin + t_on + blank < now + HEATER_SYNC_MARGIN_US)
+    origin += pwm_period_us;
+  int64_t wake = origin + t_on + (fits ? blank : 0);
+  ulTaskNotifyTake(pdTRUE, 0);
+  esp_timer_start_once(_tmr_sync, wake - now);
+  // ADC conversion-done callback notifies the task as well, a late one is not a timer wakeup
+  while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(2 * pwm_period_us / 1000 + 2))){
+    now = esp_timer_get_time();
+    if (now < wake) continue;
+    if (fits){
+      t_off = origin + t_on;
+      deadline = origin + pwm_period_us - HEATER_SYNC_MARGIN_US;
+      return true;
+    }
+    hal::pwm_off(HEATER_LEDC_SPEEDMODE, _pwm.channel, _pwm.invert);
+    // a wakeup late past next rising edge cuts that pulse short, OpAmp recovers from switch-off then
+    t_off = now < origin + pwm_period_us ? origin + t_on : now;
+    deadline = 0;
+    return true;
+  }
+
+  esp_timer_stop(_tmr_sync);
+  return false;
+}
+#endif  // HEATER_PWM_SYNC
+
+bool TipHeater::_wait_tick(TickType_t &last_wake, TickType_t period){
+  uint32_t period_us = period * portTICK_PERIOD_MS * 1000;
+  // interval to the previous tick can't be compared to a new period
+  bool rescheduled = period_us != _tick_us;
+  _tick_us = period_us;
+
+#ifdef HEATER_HW_TICK
+  if (_tick_tmr){
+    if (rescheduled){
+      gptimer_alarm_config_t alarm = {
+        .alarm_count = period_us,
+        .reload_count = 0,
+        .flags = { .auto_reload_on_alarm = true }
+      };
+      gptimer_set_alarm_action(_tick_tmr, &alarm);
+    }
+    xSemaphoreTake(_tick_sem, portMAX_DELAY);
+    // timer has fired again while previous tick was still being processed
+    uint32_t overruns = _tick_overruns;
+    if (overruns != _tick_overruns_seen){
+      while (_tick_overruns_seen != overruns){
+        _jitter.miss();
+        ++_tick_overruns_seen;
+      }
+      rescheduled = true;
+    }
+  } else
+#endif
+  if (xTaskDelayUntil(&last_wake, period) != pdTRUE){
+    _jitter.miss();
+    _tick_last = 0;
+    return false;
+  }
+
+  int64_t now = esp_timer_get_time();
+  if (_tick_last && !rescheduled){
+    int64_t dt = now - _tick_last;
+    uint32_t jitter = dt > period_us ? dt - period_us : period_us - dt;
+    if (_jitter.add(jitter) % HEATER_JITTER_REPORT == 0){
+      LOGD(T_HEAT, printf, "tick jitter p50:%u us, p99:%u us, missed:%u\n", _jitter.percentile(50), _jitter.percentile(99), _jitter.misses());
+    }
+  }
+  _tick_last = now;
+  return true;
+}
+
+#ifdef HEATER_HW_TICK
+bool TipHeater::_cb_tick(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg){
+  TipHeater* self = static_cast<TipHeater*>(arg);
   BaseType_t task_awoken{0};
-  // notify that rampUp has been complete
-  EVT_POST_ISR(IRON_NOTIFY, e2int(evt::iron_t::statePWRRampCmplt), &task_awoken);
-  task_awoken |= xTaskResumeFromISR(static_cast<TipHeater*>(arg)->_task_hndlr);
+  // previous tick has not been taken by heater task yet
+  if (xSemaphoreGiveFromISR(self->_tick_sem, &task_awoken) != pdTRUE)
+    self->_tick_overruns = self->_tick_overruns + 1;
   return task_awoken;
 }
+#endif
 
 
 // 对32个ADC读数进行平均以降噪
 //  VP+_Ru = 100k, Rd_GND = 1K
-float TipHeater::_denoiseADC(){
-  std::array<uint32_t, HEATER_ADC_SAMPLES> samples;
+bool TipHeater::_denoiseADC(temp_t &t, int64_t t_off, int64_t deadline){
+  uint32_t result{0};
+  // start times of recent sample blocks, the oldest one of a settled window is recorded to settle stats
+  std::array<int64_t, 3> starts{};
+  _recovery.start();
 
-  for (auto &i : samples){
-    i = analogReadMilliVolts(TIP_ADC_SENSOR_PIN);
-    // value = constrain(0.4432 * raw_adc + 29.665, 20, 1000);
-  }
+  // capture sample blocks until OpAmp output converges
+  for (;;){
+    int64_t start = esp_timer_get_time();
+    // DMA capture, heater task is blocked until buffer is filled
+    if (_adc.capture(_samples.data(), _samples.size(), pdMS_TO_TICKS(HEATER_ADC_TIMEOUT_MS)) != _samples.size()){
+      LOGW(T_HEAT, println, "Tip ADC capture failed");
+      return false;
+    }
+
+    // get the average of the middle readings, dropping outliers 获取中间读数的平均值
+#if defined(ADC_DEBUG_LEVEL) && ADC_DEBUG_LEVEL == 5
+    uint32_t cycles = esp_cpu_get_cycle_count();
+#endif
+    result = dsp::trimmed_mean<HEATER_ADC_TRIM>(_samples);
+#if defined(ADC_DEBUG_LEVEL) && ADC_DEBUG_LEVEL == 5
+    cycles = esp_cpu_get_cycle_count() - cycles;
+    ADC_LOGV(T_ADC, printf, "block mV:%u, filter cycles:%u\n", result, cycles);
+#endif
+
+    // heater has been off for long, no need to wait for OpAmp
+    if (!t_off) break;
 
-  // sort resultArray with low time complexity
-  // 用低时间复杂度对resultArray进行排序
-  for (size_t i = 0; i < samples.size(); ++i){
-    for (size_t j = i + 1; j < samples.size(); ++j){
-      if (samples[i] > samples[j]) {
-        std::swap(samples[i], samples[j]);
+    starts[2] = starts[1]; starts[1] = starts[0]; starts[0] = start;
+    if (int32_t mv; _recovery.feed(result, mv)){
+      // OpAmp recovery tail left, if any, is corrected for
+      result = mv < 0 ? 0 : mv;
+      // settled window starts two blocks back when it is extrapolated, one block back otherwise
+      int64_t from = starts[_recovery.blocks() > 2 ? 2 : 1];
+      if (_settle.add(from - t_off) % HEATER_SETTLE_REPORT == 0){
+        LOGD(T_HEAT, printf, "OpAmp settle p50:%u us, p90:%u us, timeouts:%u, recovery ratio:%.3f\n", _settle.percentile(50), _settle.percentile(90), _settle.misses(), _recovery.ratio());
       }
+      break;
     }
-  }
 
-  uint32_t result{0};
-  // get the average of the middle 4 readings 获取中间20个读数的平均值
-  for (uint8_t i = 2; i < 6; i++) {
-    result += samples[i];
+    int64_t now = esp_timer_get_time();
+    // PWM off-phase is over
+    if (deadline && now + adc_capture_us > deadline) return false;
+
+    // wait is extended while OpAmp output is still recovering, up to twice the nominal
+    int64_t waited = now - t_off;
+    if (waited > HEATER_OPAMP_STABILIZE_MS * 1000 && (!_recovery.falling() || waited > 2 * HEATER_OPAMP_STABILIZE_MS * 1000)){
+      // OpAmp output keeps drifting, take last reading as is
+      _settle.miss();
+      break;
+    }
   }
-  result /= 4;
 
   // convert mV to Celsius
-  float t = clamp(0.5378 * result + 6.3959, 20.0, 1000.0);
-  ADC_LOGV(T_ADC, printf, "avg mV:%u / Temp C:%6.1f\n", result, t);
+  t = mv2celsius<temp_t>(result);
+  ADC_LOGV(T_ADC, printf, "avg mV:%u / Temp C:%6.1f\n", result, static_cast<float>(t));
 ////  resultArray[i] = constrain(0.5378 * raw_adc + 6.3959, 20, 1000); // y = 0.5378x + 6.3959;
-  return t;
+  return true;
 }
 
-/*
-// calculates real temperature value according to ADC reading and calibration
-// values 根据ADC读数和校准值，计算出真实的温度值
-int32_t calculateTemp(float t) {
-//  if (RawTemp < 200)
-//    CurrentTemp = map(RawTemp, 20, 200, 20, CalTemp[CurrentTip][0]);
-  if (t < 200)
-    return map(static_cast<long>(t), 20, 200, 20, CalTemp[CurrentTip][0]);
 
-  if (t < 280)
-    return map(static_cast<long>(t), 200, 280, CalTemp[CurrentTip][0], CalTemp[CurrentTip][1]);
+// *** TimeStats methods ***
+
+template <uint32_t bin_us, size_t bins, uint32_t window>
+uint32_t TimeStats<bin_us, bins, window>::add(uint32_t us){
+  size_t bin = us / bin_us;
+  ++_hist[bin < _hist.size() ? bin : _hist.size() - 1];
+
+  // let old samples fade out, so that distribution follows changing conditions
+  if (++_cnt == window){
+    _cnt = 0;
+    for (auto &h : _hist){
+      h /= 2;
+      _cnt += h;
+    }
+  }
+  return ++_total;
+}
+
+template <uint32_t bin_us, size_t bins, uint32_t window>
+uint32_t TimeStats<bin_us, bins, window>::percentile(uint32_t p, uint32_t dflt) const {
+  if (!_cnt) return dflt;
+  uint32_t threshold = (_cnt * p + 99) / 100, sum{0};
+  for (size_t i = 0; i != _hist.size(); ++i){
+    sum += _hist[i];
+    if (sum >= threshold) return (i + 1) * bin_us;
+  }
+  return _hist.size() * bin_us;
+}
 
-  return map(static_cast<long>(t), 280, 360, CalTemp[CurrentTip][1], CalTemp[CurrentTip][2]);
+template <uint32_t bin_us, size_t bins, uint32_t window>
+void TimeStats<bin_us, bins, window>::reset(){
+  _hist.fill(0);
+  _cnt = _total = _misses = 0;
 }
 
-*/
\ No newline at end of file
+template class TimeStats<HEATER_SETTLE_BIN_US, HEATER_SETTLE_BINS, HEATER_SETTLE_WINDOW>;
+template class TimeStats<HEATER_JITTER_BIN_US, HEATER_JITTER_BINS, HEATER_JITTER_WINDOW>;
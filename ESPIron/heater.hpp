@@ -1,14 +1,146 @@
 #pragma once
+#include <array>
+#include <atomic>
 #include "common.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/ledc.h"
-#include "FastPID.h"
+#include "esp_timer.h"
+#ifdef HEATER_HW_TICK
+#include "freertos/semphr.h"
+#include "driver/gptimer.h"
+#endif
+#include "heater_hal.hpp"
+#include "fixed.hpp"
+#include "autotune.hpp"
+#include "estimator.hpp"
+#include "calibration.hpp"
+#include "dsp.hpp"
+#include "faultdetect.hpp"
+#include "pid.hpp"
+#include "evtreg.hpp"
+#include "mailbox.hpp"
 
 #define HEATER_MEASURE_RATE       10                    // Tip temperature measuring rate in working mode, Hz
+#define HEATER_RATE_MID           25                    // control loop rate when tip temperature deviates from target, Hz
+#define HEATER_RATE_HIGH          50                    // control loop rate on thermal load, Hz
+#define HEATER_RATE_STABLE_BAND   2                     // tip temperature is considered stable within this deviation from target, C
+#define HEATER_RATE_STABLE_MS     2000                  // time temperature must be stable to lower control loop rate one step down, ms
+#define HEATER_OFF_SHARE_MAX      10                    // max share of control period heater is held off for measurement while output is saturated, %
+#define HEATER_LOAD_SLOPE         20                    // tip cooling rate considered as a thermal load, C/sec
+#define HEATER_LOAD_BAND          5                     // load is detected only if tip temperature was within this deviation from target, C
+#define HEATER_LOAD_BOOST_MS      500                   // thermal load power boost duration, boost decays linearly handing control back to PID, ms
+#define HEATER_VIN_REF_MV         20000                 // supply voltage PID gains are tuned for by default, mV
+#define HEATER_FF_VIN_MIN         5000                  // supply voltage readings below this are ignored for feed-forward, mV
+#define HEATER_CJ_MIN             -20                   // valid cold junction (accelerometer die) temperature range, C
+#define HEATER_CJ_MAX             85
+#define HEATER_FAULT_TMAX         (TEMP_MAX + 30)       // tip temperature considered as thermal runaway, C
+#define TIP_PROFILE_VERSION       7                     // tip profile NVS layout version, increment on any change to TipProfile struct
+#define HEATER_RMEAS_PULSE_US     1000                  // heater pulse Vin droop for tip resistance is measured after, us
+#define HEATER_RMEAS_SAMPLES      8                     // number of Vin readings to average for tip resistance measurement
+#define HEATER_RMEAS_DROOP_MIN    20                    // min Vin droop tip resistance could be estimated from, mV
+#define HEATER_TIP_R_TOLERANCE    10                    // tip resistance match tolerance, %
+#define HEATER_PID_SCHEDULE_MERGE 25                    // autotune replaces gain schedule point closer than this to target, otherwise adds a new one, C
+#define HEATER_SETTLE_TOLERANCE_MV 2                    // OpAmp output is considered settled when it's estimated remaining recovery is below this, mV
+#define HEATER_SETTLE_LEARN_MV    20                    // min block to block step OpAmp recovery rate is learned from, mV
+#define HEATER_SETTLE_EXTRAP_MV   40                    // max remaining OpAmp recovery a reading is corrected for, mV
+#define HEATER_SETTLE_BIN_US      250                   // OpAmp settle time histogram bin width, us
+#define HEATER_SETTLE_BINS        40                    // OpAmp settle time histogram bins
+#define HEATER_SETTLE_WINDOW      1024                  // number of samples after which settle time histogram is decayed by half
+#define HEATER_JITTER_BIN_US      100                   // control tick jitter histogram bin width, us
+#define HEATER_JITTER_BINS        50                    // control tick jitter histogram bins
+#define HEATER_JITTER_WINDOW      1024                  // number of ticks after which jitter histogram is decayed by half
+#define HEATER_ADC_SAMPLES        64                    // number of ADC reads to averate tip tempearture
 
-// Define PID tuning parameters
+// tip temperature type used in measurement, smoothing and PID path
+#ifdef HEATER_FIXED_POINT
+using temp_t = q16_t;
+#else
+using temp_t = float;
+#endif
+
+static_assert(HEATER_FAULT_TMAX < TEMP_NOTIP, "over-temperature threshold must be below no-tip detection");
+
+// Define PID tuning parameters, duty at 8-bit resolution per C
 constexpr float consKp = 5, consKi = 1, consKd = 6;
+// default gain schedule, a single point, gains are same for any target
+constexpr pid::Schedule<float> default_schedule{ 1, {{ {TEMP_DEFAULT, {consKp, consKi, consKd}} }} };
+
+// default tip calibration, temperatures measured at 200/280/360 C marks are mapped to configured values
+static_assert(CALNUM <= CALIB_POINTS_MAX, "too many calibration points");
+constexpr calib::Curve default_calibration{ CALNUM, calib::interp_t::linear, {{ {20, 20}, {200, TEMP200}, {280, TEMP280}, {360, TEMP360} }} };
+// LUT for default calibration, built at compile time
+constexpr calib::LUT default_lut = calib::LUT::build(default_calibration);
+
+/**
+ * @brief per-tip configuration
+ * stored in NVS as a blob, profiles with mismatched version or size are discarded and defaults are used
+ */
+struct TipProfile {
+  uint32_t version{TIP_PROFILE_VERSION};
+  // PID gains scheduled by target temperature
+  pid::Schedule<float> pid{default_schedule};
+  // supply voltage PID gains were tuned at, mV
+  uint32_t vref{HEATER_VIN_REF_MV};
+  // temperature calibration curve
+  calib::Curve cal{default_calibration};
+  // cold junction (chip) temperature at the time of calibration, C
+  float tcj{TEMPCHP};
+  // heater resistance measured on tip insert, mOhm scaled by HEATER_SUPPLY_R_MOHM estimate, 0 if unknown
+  uint32_t r_mohm{0};
+};
+
+/**
+ * @brief time interval statistics
+ * a histogram of observed time intervals, old samples fade out every 'window' records,
+ * so that distribution follows changing conditions
+ *
+ * @tparam bin_us histogram bin width, us
+ * @tparam bins number of bins, the last one collects all longer intervals
+ * @tparam window number of records after which histogram is decayed by half
+ */
+template <uint32_t bin_us, size_t bins, uint32_t window>
+class TimeStats {
+  std::array<uint32_t, bins> _hist{};
+  // samples in histogram
+  uint32_t _cnt{0};
+  // total samples recorded
+  uint32_t _total{0};
+  // number of events that could not be measured (i.e. OpAmp did not settle in time or a control tick was missed)
+  uint32_t _misses{0};
+
+public:
+  /**
+   * @brief record observed time interval
+   *
+   * @param us time interval, us
+   * @return uint32_t total number of records since reset
+   */
+  uint32_t add(uint32_t us);
+
+  // record an event that could not be measured
+  void miss(){ ++_misses; }
+
+  /**
+   * @brief get time interval that covers specified share of observed cases
+   *
+   * @param p percentile, 0-100
+   * @param dflt value to return if no data has been recorded yet
+   * @return uint32_t time interval, us
+   */
+  uint32_t percentile(uint32_t p, uint32_t dflt = 0) const;
+
+  uint32_t count() const { return _total; }
+  uint32_t misses() const { return _misses; }
+
+  // clear statistics
+  void reset();
+};
+
+// OpAmp settle time statistics, times it takes for tip sense OpAmp to stabilize after heater switch-off
+using SettleStats = TimeStats<HEATER_SETTLE_BIN_US, HEATER_SETTLE_BINS, HEATER_SETTLE_WINDOW>;
+// control loop tick jitter statistics, deviation of tick-to-tick interval from scheduled period
+using JitterStats = TimeStats<HEATER_JITTER_BIN_US, HEATER_JITTER_BINS, HEATER_JITTER_WINDOW>;
 
 /**
  * @brief Class that manages Iron tip heating
@@ -28,8 +160,12 @@ class TipHeater {
   {
     // target Tip temperature the heater will try to match
     int32_t target;
-    // averaged measured tip temperature
-    float avg;
+    // averaged (estimated) tip temperature
+    temp_t avg;
+    // estimated rate of tip temperature change, C/sec
+    float rate;
+    // calibrated temperature with fractional part, PID input
+    temp_t precise;
     // averaged temperature with applied calibration mapping
     int32_t calibrated;
   };
@@ -51,16 +187,150 @@ class TipHeater {
 
   TaskHandle_t    _task_hndlr = nullptr;
 
+  // tip temperature sense ADC
+  hal::TipADC _adc;
+  // ADC sample block, kept off heater task's stack
+  std::array<uint32_t, HEATER_ADC_SAMPLES> _samples;
+
+  // PWM off-phase wake-up timer
+  esp_timer_handle_t _tmr_sync = nullptr;
+  // time of last PWM timer restart, us, PWM periods start at multiples of period from it, 0 if phase is unknown
+  int64_t _pwm_origin{0};
+
+  // OpAmp settle time statistics
+  SettleStats _settle;
+  // OpAmp recovery tracker, learns it's rate
+  dsp::Recovery _recovery{HEATER_SETTLE_TOLERANCE_MV, HEATER_SETTLE_LEARN_MV, HEATER_SETTLE_EXTRAP_MV};
+
+  // control tick jitter statistics and the time of last tick, us
+  JitterStats _jitter;
+  int64_t _tick_last{0};
+  // period control tick was scheduled with, us
+  uint32_t _tick_us{0};
+
+#ifdef HEATER_HW_TICK
+  // control tick timer and a semaphore it gives to heater task
+  gptimer_handle_t _tick_tmr = nullptr;
+  SemaphoreHandle_t _tick_sem = nullptr;
+  // ticks given while previous one has not been taken yet, written from ISR only
+  volatile uint32_t _tick_overruns{0};
+  uint32_t _tick_overruns_seen{0};
+#endif
+
+  // current control loop rate, Hz
+  uint32_t _rate{HEATER_MEASURE_RATE};
+  // time heater was held off for measurement on current tick, us, 0 if it was measured within PWM off-phase
+  uint32_t _off_us{0};
+  // duty averaged over control period, measurement off-time included
+  uint32_t _duty_avg{0};
+  // number of consecutive control ticks with stable temperature
+  uint32_t _stable_ticks{0};
+
+  // tip resistance must be measured on next tick heater is active
+  bool _rmeas{true};
+  // last measured tip resistance, mOhm, accessed from event loop task only
+  uint32_t _tip_r{0};
+  // tip resistance measured on insert, mOhm, 0 if unknown, accessed from heater task only
+  uint32_t _rmeas_mohm{0};
+
+  // soft-start ramp request and ramp start time, us, 0 if not ramping
+  std::atomic<bool> _ramp_req{false};
+  int64_t _ramp_start{0};
+  // ramp request and active state are set together under this lock, so heater task never sees one without the other
+  portMUX_TYPE _ramp_mux = portMUX_INITIALIZER_UNLOCKED;
+
+  // thermal load power boost, duty, and the time boost ends, us
+  uint32_t _boost{0};
+  int64_t _boost_end{0};
+
+  // current tip index
+  uint32_t _tip{0};
+  // current tip profile
+  TipProfile _profile;
+  // profiles are loaded from NVS in UI lane and published here, heater task applies a new one on next tick
+  mbox::Mailbox<TipProfile> _profile_box;
+  // version of the profile heater task has applied
+  uint32_t _profile_ver{0};
+
+  // tip commands taken in control lane, ordered with a common sequence number
+  struct TipSelectReq { uint32_t idx; uint32_t seq; };
+  struct TipCalibrateReq { calib::Curve cal; uint32_t seq; };
+  uint32_t _tip_req_seq{0};
+  // control lane publishes tip commands here and kicks UI lane with tipRequest, UI lane handles the latest ones
+  mbox::Mailbox<TipSelectReq> _tip_select_box;
+  mbox::Mailbox<TipCalibrateReq> _tip_calibrate_box;
+  // versions of the tip commands UI lane has handled
+  uint32_t _tip_select_ver{0}, _tip_calibrate_ver{0};
+  // tipRequest kick did not fit into UI lane queue, heater task posts it again on next tick
+  std::atomic<bool> _tip_kick{false};
+
+  // calibration LUT for current tip
+  calib::LUT _lut{default_lut};
+
+  // PID autotuner
+  autotune::RelayTuner _tuner;
+  std::atomic<bool> _tune_req{false};
+  // tip profile with autotuned gains, kept until it's notification is posted
+  TipProfile _tuned;
+
+  // notifications to UI lane heater task has not posted yet. Heater task never waits for UI lane queue,
+  // a notification that does not fit is posted again on next tick
+  struct Outbox {
+    bool fault{false};
+    bool resistance{false};
+    bool tuned{false};
+    bool tune_fail{false};
+    bool ramp_cmplt{false};
+  } _outbox;
+
+  // tip temperature estimator and the time of it's last prediction, us
+  estimator::TipKalman _est;
+  int64_t _t_est{0};
+
+  // heater fault detector
+  faults::FaultDetector _faults{faults::Params{HEATER_FAULT_TMAX, TEMP_NOTIP}};
+
+  // latest supply voltage reading, mV, 0 if unknown
+  uint32_t _vin{0};
+  // cold junction temperature (accelerometer die), C, updated by heater task
+  std::atomic<float> _t_cj{TEMPCHP};
+  // supply voltage feed-forward is calculated for, UINT32_MAX forces recalculation
+  uint32_t _ff_vin{UINT32_MAX};
+  // supply voltage feed-forward duty scale, Q16
+  uint32_t _ff_k{1<<16};
+  // duty quantization error carried over to the next tick, Q16
+  uint32_t _dither{0};
+
+  // supply power budget, contract voltage, mV, and current limit, mA
+  std::atomic<uint32_t> _budget_mv{HEATER_VIN_REF_MV}, _budget_ma{PD_CURRENT_LIMIT};
+  // power budget and tip resistance duty cap is calculated for
+  uint32_t _cap_mv{0}, _cap_ma{0}, _cap_r{0};
+  // max duty allowed by power budget
+  uint32_t _duty_max{1<<HEATER_RES};
+
   // event handlers
   esp_event_handler_instance_t _evt_cmd_handler = nullptr;
   esp_event_handler_instance_t _evt_ntf_handler = nullptr;
 
-  // Specify variable pointers and initial PID tuning parameters
-  // 指定变量指针和初始PID调优参数
-  FastPID _pid = FastPID(consKp, consKi, consKd, HEATER_MEASURE_RATE);
+  // PID controller, runs on calibrated temperature and outputs duty in units of power at profile's reference voltage
+  pid::Controller<temp_t> _pid;
+  // time of last PID step, us
+  int64_t _t_pid{0};
+  // PID was in charge on previous tick
+  bool _pid_inband{false};
+  // PID integrator must be preset to tip's holding power on next engagement
+  std::atomic<bool> _pid_preset{true};
 
-  // events processing
-  void _evt_picker(esp_event_base_t base, int32_t id, void* data);
+  // event handlers, bound to event ids in _cmd_table and _ntf_table
+  void _evt_autotune(){ _tune_req = true; }
+  // tip commands come to control lane, NVS work is handed over to UI lane through mailboxes, so heater commands never wait for flash or UI queue
+  void _evt_tip_select(uint32_t idx){ _tip_select_box.publish({idx, ++_tip_req_seq}); _kick_tip_request(); }
+  void _evt_tip_calibrate(const calib::Curve& cal){ _tip_calibrate_box.publish({cal, ++_tip_req_seq}); _kick_tip_request(); }
+  void _evt_power_budget(const evt::PowerBudget& b);
+  // tip profile handlers in UI lane, a single loop task runs them, so NVS profile access needs no lock
+  void _ntf_tip_request();
+  void _ntf_tip_calibrate(const calib::Curve& cal);
+  void _evt_autotune_cmplt(const TipProfile& p){ _save_profile(_tip, p); }
 
   /**
    * @brief RTOS task runner that monitor tip temperature and controls heater PWM
@@ -84,7 +354,197 @@ class TipHeater {
   // 
   void _measureTipTemp();
 
-  float _denoiseADC();
+  /**
+   * @brief capture tip sense ADC samples and convert it to temperature
+   * if heater has just been switched off, sample blocks are captured until OpAmp output converges
+   *
+   * @param t measured temperature in Celsius
+   * @param t_off time when heater was switched off, us, 0 if heater has been off for long
+   * @param deadline time the measurement must be complete by, us, 0 if not limited
+   * @return false if ADC capture failed or OpAmp has not settled before deadline
+   */
+  bool _denoiseADC(temp_t &t, int64_t t_off = 0, int64_t deadline = 0);
+
+  /**
+   * @brief wait for a natural off-phase of heater PWM period to measure tip temperature
+   * PWM phase is tracked from the last timer restart, heater task sleeps till the expected end of OpAmp blanking
+   * after the falling edge of a PWM pulse, heater duty is not changed. Timer is restarted only if phase is unknown,
+   * has drifted or is due for a periodic refresh.
+   * If off-phase is too short for current duty, heater is switched off at the falling edge, so that
+   * OpAmp recovers within the off-phase and only the shortfall is taken from the next pulses
+   *
+   * @param t_off set to the time of PWM falling edge, us
+   * @param deadline set to the end of off-phase, us, 0 if heater has been switched off
+   * @return true if measurement could be done now
+   * @return false if PWM phase is not tracked and heater must be switched off for measurement
+   */
+  bool _sync_offphase(int64_t &t_off, int64_t &deadline);
+
+  /**
+   * @brief wait for next control tick and record tick jitter
+   * tick comes either from RTOS task delay or, with HEATER_HW_TICK, from GPTimer alarm
+   *
+   * @param last_wake time of the previous tick, ticks (RTOS delay mode)
+   * @param period time between ticks, ticks
+   * @return true if tick has come in time
+   * @return false if deadline has been missed, this cycle should be skipped
+   */
+  bool _wait_tick(TickType_t &last_wake, TickType_t period);
+
+  /**
+   * @brief pick control loop rate for the next PID tick
+   * loop rate is raised when temperature deviates from target or tip is loosing heat fast,
+   * and lowered step-by-step once temperature is stable. While output is saturated, rate is limited
+   * so that measurement off-time takes no more than HEATER_OFF_SHARE_MAX of heater power
+   *
+   * @return TickType_t delay till next tick
+   */
+  TickType_t _schedule_rate();
+
+  /**
+   * @brief detect thermal load and get power boost for it
+   * a sudden temperature drop near target means the tip touched a massive joint, instead of waiting for PID to catch up
+   * heater power is boosted right away by the amount that compensates for the heat drain, as per tip's thermal model.
+   * Boost decays over HEATER_LOAD_BOOST_MS and PID takes over
+   *
+   * @param t_prev tip temperature on previous tick
+   * @return uint32_t duty to be added to PID output
+   */
+  uint32_t _load_boost(int32_t t_prev);
+
+  // set control loop rate
+  void _set_rate(uint32_t hz);
+
+  /**
+   * @brief run PID step
+   * gains are picked from tip profile's schedule for current target. When PID takes over from bang-bang control
+   * for the first time after target, tip or profile change, integrator is preset to the power that holds tip at target
+   * as per tip's thermal model, so there is no bump to zero and no long wind-up. Later engagements keep the integrator,
+   * it already holds learned power
+   *
+   * @return float PID output, duty in units of power at profile's reference voltage
+   */
+  float _pid_step();
+
+  /**
+   * @brief load tip profile from NVS
+   *
+   * @param idx tip index
+   * @return TipProfile loaded profile or defaults if there is no valid profile stored
+   */
+  TipProfile _load_profile(uint32_t idx);
+
+  // save tip profile to NVS
+  esp_err_t _save_profile(uint32_t idx, const TipProfile& p);
+
+  /**
+   * @brief select current tip and load it's profile, heater task applies it on next tick
+   *
+   * @param idx tip index
+   * @param r_mohm tip resistance to store in the profile, 0 to keep stored one
+   */
+  void _select_tip(uint32_t idx, uint32_t r_mohm = 0);
+
+  // read supply voltage, mV, 0 if ADC is not available
+  uint32_t _read_vin();
+
+  /**
+   * @brief measure tip heater resistance
+   * heater is switched on for a short pulse at duty capped by power budget and Vin droop is measured within it,
+   * heater and supply path resistance make a voltage divider, so R = Rsupply * Vload / (Vopen - Vload).
+   * Rsupply is not known, HEATER_SUPPLY_R_MOHM is a guess, so the result is only proportional to real resistance.
+   * Tips are matched by relative tolerance, where the guess cancels out, as long as the supply path stays the same.
+   * Power budget cap takes it only when it is below nominal HEATER_TIP_R_MOHM, so a wrong guess never loosens the cap
+   *
+   * @return uint32_t resistance, mOhm, 0 if droop is too small to tell
+   */
+  uint32_t _measure_resistance();
+
+  /**
+   * @brief pick a tip profile matching measured resistance
+   * if current tip does not match and there is a single other tip within tolerance, that tip is selected.
+   * If nothing matches and current tip has no resistance stored yet, it is learned for current tip
+   *
+   * @param r measured resistance, mOhm
+   */
+  void _match_tip(uint32_t r);
+
+  /**
+   * @brief recalculate supply voltage feed-forward if Vin or tip profile has changed
+   * heater power is proportional to Vin^2, so PID output is treated as power at profile's reference voltage
+   * and scaled to duty with (Vref/Vin)^2, that keeps loop gain same for any PD/QC voltage.
+   * Duty is also capped by supply power budget, average supply current is duty * V / R, so max duty is I_lim * R / V,
+   * R is the lower of measured and nominal tip resistance. The cap limits average current only, while MOSFET is on
+   * supply current is V / R whatever the duty, a supply that limits current within a PWM period sees those peaks
+   * where V is the higher of contract and measured voltage
+   */
+  void _update_feedforward();
+
+  /**
+   * @brief update tip temperature estimate with a new measurement
+   * heater power applied since previous tick is used to predict temperature change
+   *
+   * @param t measured temperature
+   */
+  void _estimate(temp_t t);
+
+  // heater power share applied since last tick, relative to full power at profile's reference voltage
+  float _power_share() const;
+
+  /**
+   * @brief apply PID duty to heater PWM
+   * heater stays off for the measurement window, duty is raised for the rest of control period,
+   * so that average power matches the requested one as long as it fits under duty cap
+   *
+   * @param period time till next tick, ticks
+   */
+  void _pwm_apply(TickType_t period);
+
+  /**
+   * @brief feed fault detector with a new measurement
+   * on fault heater is shut off and latched in fault state until power cycle
+   *
+   * @param t measured temperature
+   * @return true if heater is faulted
+   */
+  bool _check_faults(temp_t t);
+
+  /**
+   * @brief convert measured temperature to calibrated one
+   * cold junction compensation is applied first, thermocouple output is proportional to tip and cold junction
+   * temperature difference, so measured value is shifted by the change of chip temperature since calibration,
+   * then the tip's calibration LUT is applied
+   */
+  temp_t _calibrate(temp_t t) const;
+
+  // reset tip temperature estimate to measured value
+  void _estimate_reset(temp_t t);
+
+  /**
+   * @brief limit heater duty with soft-start ramp
+   *
+   * @param duty duty requested by control algorithm
+   * @return uint32_t duty allowed at current ramp stage
+   */
+  uint32_t _ramp_duty(uint32_t duty);
+
+  // end soft-start ramp, if any, and notify ramp completion
+  void _ramp_end();
+
+  // start PID autotune relay test at current target temperature
+  void _autotune_start();
+
+  // run autotune relay test step and handle it's result
+  void _autotune_step();
+
+  // abort running autotune, if any
+  void _autotune_abort();
+
+  // post notifications pending in outbox to UI lane, without waiting for room in the queue
+  void _post_outbox();
+
+  // let UI lane know tip commands are waiting in mailboxes, a kick that does not fit is left for heater task to retry
+  void _kick_tip_request();
 
 public:
   TipHeater(int gpio, ledc_channel_t channel = LEDC_CHANNEL_0, bool invert = false) : _pwm({gpio, channel, invert, 0}) {};
@@ -110,8 +570,8 @@ public:
 
   /**
    * @brief Enable the heater with PWM ramp-up
-   * i.e. it heater will use HW faider to ramp PWM duty from 0 to MAX
-   * to gradualy ramp power load
+   * heater power is ramped from 0 to MAX over HEATER_RAMP_TIME_MS by control loop itself, so tip temperature
+   * is still measured and controlled, ramp ends as soon as PID band is reached
    * 
    */
   void rampUp();
@@ -137,12 +597,44 @@ public:
    */
   int32_t getCurrentTemp() const { return _t.calibrated; }
 
+  /**
+   * @brief Get OpAmp settle time statistics
+   */
+  const SettleStats& getSettleStats() const { return _settle; }
+
+  /**
+   * @brief Get control tick jitter statistics
+   */
+  const JitterStats& getJitterStats() const { return _jitter; }
+
 // other private methods
 private:
 
 // static wrapper for _runner Task to call handling class member
 static inline void _runner(void* pvParams){ ((TipHeater*)pvParams)->_heaterControl(); }
 
-static IRAM_ATTR bool _cb_ledc_fade_end_event(const ledc_cb_param_t *param, void *arg);
+// heater commands
+using _cmd_table = evt::Dispatcher<TipHeater,
+  evt::on<evt::iron_t::heaterTargetT, &TipHeater::setTargetTemp>,
+  evt::on<evt::iron_t::heaterEnable, &TipHeater::enable>,
+  evt::on<evt::iron_t::heaterDisable, &TipHeater::disable>,
+  evt::on<evt::iron_t::heaterRampUp, &TipHeater::rampUp>,
+  evt::on<evt::iron_t::heaterAutoTune, &TipHeater::_evt_autotune>,
+  evt::on<evt::iron_t::heaterTipSelect, &TipHeater::_evt_tip_select>,
+  evt::on<evt::iron_t::heaterTipCalibrate, &TipHeater::_evt_tip_calibrate>,
+  evt::on<evt::iron_t::heaterPowerBudget, &TipHeater::_evt_power_budget>
+>;
+
+// tip profiles NVS work in UI lane: save autotune results, match tips, select and calibrate tips handed over from control lane.
+// Heater task has too little stack for NVS and control lane must not be stalled by it
+using _ntf_table = evt::Dispatcher<TipHeater,
+  evt::on<evt::iron_t::tipRequest, &TipHeater::_ntf_tip_request>,
+  evt::on<evt::iron_t::autotuneCmplt, &TipHeater::_evt_autotune_cmplt>,
+  evt::on<evt::iron_t::tipResistance, &TipHeater::_match_tip>
+>;
+
+#ifdef HEATER_HW_TICK
+static IRAM_ATTR bool _cb_tick(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg);
+#endif
 
 };
@@ -0,0 +1,153 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include "Arduino.h"
+#include "driver/ledc.h"
+#include "common.hpp"
+#ifdef HEATER_SIM
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "evtreg.hpp"
+#include "thermalsim.hpp"
+#else
+#include "adc_dma.hpp"
+#endif
+
+/**
+ * Heater hardware abstraction
+ * TipHeater talks to heater PWM and tip sense ADC only via this shim,
+ * when built with HEATER_SIM flag, PWM and tip ADC are backed with a thermal plant model
+ * instead of LEDC and analogReadMilliVolts, the heater MOSFET is never driven in this mode
+ */
+namespace hal {
+
+#ifdef HEATER_SIM
+
+/**
+ * @brief simulated Iron
+ * runs thermalsim::TipPlant in real time and reports heat-up metrics for each new target temperature
+ */
+class SimIron {
+  thermalsim::TipPlant _plant;
+  thermalsim::HeatupMetrics _metrics;
+
+  std::atomic<int32_t> _target{0};
+  std::atomic<bool> _enabled{false};
+  std::atomic<bool> _restart{false};
+
+  esp_event_handler_instance_t _evt_handler = nullptr;
+
+  // heater command handlers
+  void _evt_target(int32_t t){ _target = t; _restart = true; }
+  void _evt_enable(){ _enabled = true; _restart = true; }
+  void _evt_disable(){ _enabled = false; }
+
+  using _cmd_table = evt::Dispatcher<SimIron,
+    evt::on<evt::iron_t::heaterTargetT, &SimIron::_evt_target>,
+    evt::on<evt::iron_t::heaterEnable, &SimIron::_evt_enable>,
+    evt::on<evt::iron_t::heaterDisable, &SimIron::_evt_disable>,
+    evt::on<evt::iron_t::heaterRampUp, &SimIron::_evt_enable>
+  >;
+
+  // advance plant model up to current time
+  void _sync();
+
+public:
+  SimIron();
+
+  void init();
+
+  void setDuty(uint32_t duty){ _sync(); _plant.setDuty(duty); }
+
+  uint32_t getDuty(){ _sync(); return _plant.getDuty(); }
+
+  void pwmRestart(){ _sync(); _plant.pwmRestart(); }
+
+  uint32_t senseMilliVolts(){ _sync(); return static_cast<uint32_t>(_plant.senseMilliVolts()); }
+
+  // plant model advanced to current time, i.e. for load and fault injection from a host harness
+  thermalsim::TipPlant& plant(){ _sync(); return _plant; }
+};
+
+extern SimIron sim;
+
+inline void init(){ sim.init(); }
+
+inline void pwm_duty(ledc_mode_t, ledc_channel_t, uint32_t duty){ sim.setDuty(duty); }
+
+inline uint32_t pwm_get_duty(ledc_mode_t, ledc_channel_t){ return sim.getDuty(); }
+
+inline void pwm_restart(ledc_mode_t, ledc_timer_t){ sim.pwmRestart(); }
+
+inline void pwm_off(ledc_mode_t, ledc_channel_t, uint32_t){ sim.setDuty(0); }
+
+inline uint32_t adc_mv(uint8_t pin){ return pin == TIP_ADC_SENSOR_PIN ? sim.senseMilliVolts() : analogReadMilliVolts(pin); }
+
+/**
+ * @brief tip sense sampler backed with simulated OpAmp output
+ */
+class SimTipADC {
+  // sampling period, us
+  uint32_t _period{0};
+public:
+  esp_err_t init(int, size_t, uint32_t freq){ _period = 1000000 / freq; return ESP_OK; }
+  size_t capture(uint32_t* mv, size_t n, TickType_t){
+    // keep real sampling timing, so that OpAmp recovery is seen the same way as with DMA
+    for (size_t i = 0; i != n; ++i){
+      mv[i] = sim.senseMilliVolts();
+      delayMicroseconds(_period);
+    }
+    return n;
+  }
+};
+
+using TipADC = SimTipADC;
+
+#else   // HEATER_SIM
+
+inline void init(){}
+
+/**
+ * @brief set and apply heater PWM duty
+ */
+inline void pwm_duty(ledc_mode_t mode, ledc_channel_t ch, uint32_t duty){
+  ledc_set_duty(mode, ch, duty);
+  ledc_update_duty(mode, ch);
+}
+
+inline uint32_t pwm_get_duty(ledc_mode_t mode, ledc_channel_t ch){ return ledc_get_duty(mode, ch); }
+
+/**
+ * @brief switch PWM output off right away, not waiting for the end of current PWM period
+ * next pwm_duty() call will resume PWM output
+ */
+inline void pwm_off(ledc_mode_t mode, ledc_channel_t ch, uint32_t idle_level){
+  ledc_set_duty(mode, ch, 0);
+  ledc_stop(mode, ch, idle_level);
+}
+
+/**
+ * @brief restart PWM timer counter, i.e. start a new PWM period right now
+ */
+inline void pwm_restart(ledc_mode_t mode, ledc_timer_t timer){ ledc_timer_rst(mode, timer); }
+
+/**
+ * @brief read calibrated ADC value in mV
+ */
+inline uint32_t adc_mv(uint8_t pin){ return analogReadMilliVolts(pin); }
+
+// tip sense sampler
+using TipADC = ADCSampler_DMA;
+
+#endif  // HEATER_SIM
+
+} // namespace hal
@@ -66,12 +66,12 @@ using namespace muipp;
 
 IronHID::~IronHID(){
   if (_evt_viset_handler){
-      esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_VISET, ESP_EVENT_ANY_ID, _evt_viset_handler);
+      evt::unsubscribe(IRON_VISET, ESP_EVENT_ANY_ID, _evt_viset_handler);
     _evt_viset_handler = nullptr;
   }  
 
   if (_evt_ntfy_handler){
-      esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_NOTIFY, e2int( iron_t::stateSuspend ), _evt_ntfy_handler);
+      evt::unsubscribe(IRON_NOTIFY, e2int( iron_t::stateSuspend ), _evt_ntfy_handler);
     _evt_ntfy_handler = nullptr;
   }
 
@@ -92,8 +92,7 @@ void IronHID::init(){
 
   // subscribe to notification events
   if (!_evt_ntfy_handler){
-    esp_event_handler_instance_register_with(
-      evt::get_hndlr(),
+    evt::subscribe(
       IRON_NOTIFY,
       e2int( iron_t::stateSuspend ),    // I need only 'suspend' for now
       // notification on suspend
@@ -123,8 +122,7 @@ void IronHID::_init_screen(){
 #endif
 
   // subscribe to ViSet events
-  esp_event_handler_instance_register_with(
-    evt::get_hndlr(),
+  evt::subscribe(
     IRON_VISET,
     ESP_EVENT_ANY_ID,
     // VisualSet switching events
@@ -214,7 +212,7 @@ void IronHID::_viset_spawn(viset_evt_t v){
 
   // if switched to any screen but main, switch iron to idle mode
   if (v != viset_evt_t::vsMainScreen)
-    EVT_POST(IRON_SET_EVT, e2int(iron_t::stateIdle));
+    evt::post<iron_t::stateIdle>(IRON_SET_EVT);
 }
 
 void IronHID::_viset_render(){
@@ -241,15 +239,14 @@ void IronHID::_viset_render(){
 // ***** VisualSet - Generic *****
 VisualSet::VisualSet(GPIOButton<ESPEventPolicy> &button, PseudoRotaryEncoder &encoder) : btn(button), encdr(encoder) {
   // subscribe to button events
-  esp_event_handler_instance_register_with(evt::get_hndlr(), EBTN_EVENTS, ESP_EVENT_ANY_ID, VisualSet::_event_picker, this, &_evt_btn_handler);
+  evt::subscribe(EBTN_EVENTS, ESP_EVENT_ANY_ID, VisualSet::_event_picker, this, &_evt_btn_handler);
 
   // subscribe to encoder events
-  esp_event_handler_instance_register_with(evt::get_hndlr(), EBTN_ENC_EVENTS, ESP_EVENT_ANY_ID, VisualSet::_event_picker, this, &_evt_enc_handler);
+  evt::subscribe(EBTN_ENC_EVENTS, ESP_EVENT_ANY_ID, VisualSet::_event_picker, this, &_evt_enc_handler);
 
 /*
   // subscribe to all events on a bus
-  ESP_ERROR_CHECK(esp_event_handler_instance_register_with(
-                    evt::get_hndlr(),
+  ESP_ERROR_CHECK(evt::subscribe(
                     ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID,
                     VisualSet::_event_picker,
                     this, &_evt_handler)
@@ -261,11 +258,11 @@ VisualSet::~VisualSet(){
   LOGD(T_HID, println, "~VisualSet d-tor");
   // unsubscribe from an event bus
   if (_evt_btn_handler){
-    esp_event_handler_instance_unregister_with(evt::get_hndlr(), EBTN_EVENTS, ESP_EVENT_ANY_ID, _evt_btn_handler);
+    evt::unsubscribe(EBTN_EVENTS, ESP_EVENT_ANY_ID, _evt_btn_handler);
     _evt_btn_handler = nullptr;
   }
   if (_evt_enc_handler){
-    esp_event_handler_instance_unregister_with(evt::get_hndlr(), EBTN_ENC_EVENTS, ESP_EVENT_ANY_ID, _evt_enc_handler);
+    evt::unsubscribe(EBTN_ENC_EVENTS, ESP_EVENT_ANY_ID, _evt_enc_handler);
     _evt_enc_handler = nullptr;
   }
 }
@@ -298,22 +295,10 @@ void VisualSet::_event_picker(void* arg, esp_event_base_t base, int32_t id, void
 ViSet_MainScreen::ViSet_MainScreen(GPIOButton<ESPEventPolicy> &button, PseudoRotaryEncoder &encoder) : VisualSet(button, encoder) {
   //LOGV(printf, "ViSet_MainScreen::_event_picker %s:%d\n", base, id);
 
-  // subscribe to sensor events
-  esp_event_handler_instance_register_with(evt::get_hndlr(), SENSOR_DATA, ESP_EVENT_ANY_ID,
-            [](void* self, esp_event_base_t base, int32_t id, void* data) { static_cast<ViSet_MainScreen*>(self)->_evt_sensor(id, data); },
-            this, &_evt_snsr_handler);
   // subscribe to notify events
-  esp_event_handler_instance_register_with(evt::get_hndlr(), IRON_NOTIFY, ESP_EVENT_ANY_ID,
-            [](void* self, esp_event_base_t base, int32_t id, void* data) { static_cast<ViSet_MainScreen*>(self)->_evt_notify(id, data); },
-            this, &_evt_ntfy_handler);
-  // subscribe to notify events
-  esp_event_handler_instance_register_with(evt::get_hndlr(), IRON_SET_EVT, ESP_EVENT_ANY_ID,
-            [](void* self, esp_event_base_t base, int32_t id, void* data) { static_cast<ViSet_MainScreen*>(self)->_evt_cmd(id, data); },
-            this, &_evt_set_handler);
-  // subscribe to notify events
-  esp_event_handler_instance_register_with(evt::get_hndlr(), IRON_STATE, ESP_EVENT_ANY_ID,
-            [](void* self, esp_event_base_t base, int32_t id, void* data) { static_cast<ViSet_MainScreen*>(self)->_evt_state(id, data); },
-            this, &_evt_state_handler);
+  _ntfy_table::subscribe(IRON_NOTIFY, this, &_evt_ntfy_handler);
+  // subscribe to working temperature state
+  evt::subscribe<iron_t::workTemp, &ViSet_MainScreen::_evt_work_temp>(IRON_STATE, this, &_evt_state_handler);
 
 
   // configure button and encoder
@@ -330,22 +315,23 @@ ViSet_MainScreen::ViSet_MainScreen(GPIOButton<ESPEventPolicy> &button, PseudoRot
   nvs_blob_read(T_IRON, T_temperatures, static_cast<void*>(&_temp), sizeof(Temperatures));
 
   // request working temperature from IronController
-  EVT_POST(IRON_GET_EVT, e2int(iron_t::workTemp));
+  evt::request<iron_t::workTemp>();
 }
 
 ViSet_MainScreen::~ViSet_MainScreen(){
-  esp_event_handler_instance_unregister_with(evt::get_hndlr(), SENSOR_DATA, ESP_EVENT_ANY_ID, _evt_snsr_handler);
-  _evt_snsr_handler = nullptr;
-  esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_NOTIFY, ESP_EVENT_ANY_ID, _evt_ntfy_handler);
+  _ntfy_table::unsubscribe(IRON_NOTIFY, _evt_ntfy_handler);
   _evt_ntfy_handler = nullptr;
-  esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_SET_EVT, ESP_EVENT_ANY_ID, _evt_set_handler);
-  _evt_set_handler = nullptr;
-  esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_STATE, ESP_EVENT_ANY_ID, _evt_state_handler);
+  evt::unsubscribe(IRON_STATE, e2int(iron_t::workTemp), _evt_state_handler);
   _evt_state_handler = nullptr;
   LOG(println, "d-tor ViSet_MainScreen");
 }
 
 void ViSet_MainScreen::drawScreen(){
+  // pick latest sensor readings
+  evt::latest::tiptemp.read(_tip_temp);
+  evt::latest::vin.read(_vin);
+  evt::latest::acceltemp.read(_sns_temp);
+
   u8g2.clearBuffer();
 
   u8g2.setFont(MAINSCREEN_FONT);
@@ -456,62 +442,9 @@ void ViSet_MainScreen::drawScreen(){
   u8g2.sendBuffer();
 }
 
-void ViSet_MainScreen::_evt_sensor(int32_t id, void* data){
-  switch(static_cast<evt::iron_t>(id)){
-    case evt::iron_t::tiptemp :
-      _tip_temp = *reinterpret_cast<int32_t*>(data);
-      break;
-    case evt::iron_t::vin :
-      _vin = *reinterpret_cast<uint32_t*>(data);
-      break;
-    case evt::iron_t::acceltemp :
-      _sns_temp = *reinterpret_cast<float*>(data);
-      break;
-  }
-  //_drawMainScreen();
-}
-
-void ViSet_MainScreen::_evt_notify(int32_t id, void* data){
-  switch(static_cast<evt::iron_t>(id)){
-    case evt::iron_t::stateIdle :
-      _state = ironState_t::idle;
-      break;
-    case evt::iron_t::stateWorking :
-      _state = ironState_t::working;
-      break;
-    case evt::iron_t::stateStandby :
-      _state = ironState_t::standby;
-      break;
-    case evt::iron_t::stateBoost :
-      _state = ironState_t::boost;
-      break;
-    case evt::iron_t::statePWRRampStart :
-      _state = ironState_t::ramping;
-      break;
-    case evt::iron_t::statePWRRampCmplt :
-      _state = ironState_t::working;
-      break;
-  }
-}
-
-void ViSet_MainScreen::_evt_cmd(int32_t id, void* data){
-/*  not used currently
-  switch(static_cast<evt::iron_t>(id)){
-    case evt::iron_t::workTemp :
-      _temp.working = *reinterpret_cast<int32_t*>(data);
-      encdr.setCounter(_temp.working, TEMP_STEP, TEMP_MIN, TEMP_MAX);
-    break;
-  }
-*/
-}
-
-void ViSet_MainScreen::_evt_state(int32_t id, void* data){
-  switch(static_cast<evt::iron_t>(id)){
-    case evt::iron_t::workTemp :
-      _temp.working = *reinterpret_cast<int32_t*>(data);
-      encdr.setCounter(_temp.working, TEMP_STEP, TEMP_MIN, TEMP_MAX);
-    break;
-  }
+void ViSet_MainScreen::_evt_work_temp(int32_t t){
+  _temp.working = t;
+  encdr.setCounter(_temp.working, TEMP_STEP, TEMP_MIN, TEMP_MAX);
 }
 
 void ViSet_MainScreen::_evt_button(ESPButton::event_t e, const EventMsg* m){
@@ -520,7 +453,7 @@ void ViSet_MainScreen::_evt_button(ESPButton::event_t e, const EventMsg* m){
   switch(e){
     // Use click event to toggle iron working mode on/off
     case event_t::click :
-      EVT_POST(IRON_SET_EVT, e2int(iron_t::workModeToggle));
+      evt::post<iron_t::workModeToggle>(IRON_SET_EVT);
       break;
 
     // use longPress to enter configuration menu
@@ -532,7 +465,7 @@ void ViSet_MainScreen::_evt_button(ESPButton::event_t e, const EventMsg* m){
     case event_t::multiClick :
       // doubleclick to toggle boost mode
       if (m->cntr == 2)
-        EVT_POST(IRON_SET_EVT, e2int(iron_t::boostModeToggle));
+        evt::post<iron_t::boostModeToggle>(IRON_SET_EVT);
       break;
   }
 }
@@ -540,7 +473,7 @@ void ViSet_MainScreen::_evt_button(ESPButton::event_t e, const EventMsg* m){
 void ViSet_MainScreen::_evt_encoder(ESPButton::event_t e, const EventMsg* m){
   // main Iron screen mode - encoder controls Iron working temperature
   _temp.working = m->cntr; // reinterpret_cast<EventMsg*>(event_data)->cntr;
-  EVT_POST_DATA(IRON_SET_EVT, e2int(iron_t::workTemp), &_temp.working, sizeof(_temp.working));
+  evt::post<iron_t::workTemp>(IRON_SET_EVT, _temp.working);
 }
 
 
@@ -742,7 +675,7 @@ ViSet_TemperatureSetup::~ViSet_TemperatureSetup(){
   t.savewrk =  save_work;
   nvs_blob_write(T_IRON, T_temperatures, &t, sizeof(decltype(t)));
   // send command to reload temp settings
-  EVT_POST(IRON_SET_EVT, e2int(iron_t::reloadTemp));
+  evt::post<iron_t::reloadTemp>(IRON_SET_EVT);
 }
 
 void ViSet_TemperatureSetup::_buildMenu(){
@@ -887,7 +820,7 @@ ViSet_TimeoutsSetup::~ViSet_TimeoutsSetup(){
   // save settings to NVS
   nvs_blob_write(T_IRON, T_timeouts, &t, sizeof(decltype(t)));
   // send command to reload time settings
-  EVT_POST(IRON_SET_EVT, e2int(iron_t::reloadTimeouts));
+  evt::post<iron_t::reloadTimeouts>(IRON_SET_EVT);
 }
 
 void ViSet_TimeoutsSetup::_buildMenu(){
@@ -1012,22 +945,10 @@ ViSet_PwrSetup::ViSet_PwrSetup(GPIOButton<ESPEventPolicy> &button, PseudoRotaryE
   if (_voption == _pd_voltage.cend())
     _voption = _pd_voltage.cbegin();
 
-  // subscribe to Vin sensor data
-  esp_event_handler_instance_register_with(evt::get_hndlr(), SENSOR_DATA, e2int(evt::iron_t::vin),
-            [](void* self, esp_event_base_t base, int32_t id, void* data){
-              static_cast<ViSet_PwrSetup*>(self)->_vin = *static_cast<uint32_t*>(data);
-              static_cast<ViSet_PwrSetup*>(self)->_rr = true;    // refresh screen on updated value
-            },
-            this, &_evt_snsr_handler);
-
   _buildMenu();
 }
 
 ViSet_PwrSetup::~ViSet_PwrSetup(){
-  // unsubscribe sensor events
-  esp_event_handler_instance_unregister_with(evt::get_hndlr(), SENSOR_DATA, e2int(evt::iron_t::vin), _evt_snsr_handler);
-  _evt_snsr_handler = nullptr;
-
   // save PD voltage value to NVS
   esp_err_t err;
   std::unique_ptr<nvs::NVSHandle> handle = nvs::open_nvs_handle(T_IRON, NVS_READWRITE, &err);
@@ -1039,7 +960,19 @@ ViSet_PwrSetup::~ViSet_PwrSetup(){
   }
 
   // command for PWM ramping
-  EVT_POST(IRON_SET_EVT, _pwm_ramp ? e2int(iron_t::enablePWMRamp) : e2int(iron_t::disablePWMRamp) );
+  if (_pwm_ramp)
+    evt::post<iron_t::enablePWMRamp>(IRON_SET_EVT);
+  else
+    evt::post<iron_t::disablePWMRamp>(IRON_SET_EVT);
+}
+
+void ViSet_PwrSetup::drawScreen(){
+  uint32_t ver = evt::latest::vin.read(_vin);
+  if (ver != _vin_ver){
+    _vin_ver = ver;
+    _rr = true;
+  }
+  MuiMenu::drawScreen();
 }
 
 void ViSet_PwrSetup::_buildMenu(){
@@ -1206,7 +1139,7 @@ void ViSet_PwrSetup::_pd_next_val(){
   if (_voption == _pd_voltage.cend())
     _voption = _pd_voltage.cbegin();
   _volts_pd = *_voption;
-  EVT_POST_DATA(IRON_SET_EVT, e2int(iron_t::pdVoltage), &_volts_pd, sizeof(_volts_pd));
+  evt::post<iron_t::pdVoltage>(IRON_SET_EVT, _volts_pd);
 }
 
 void ViSet_PwrSetup::_pd_prev_val(){
@@ -1214,7 +1147,7 @@ void ViSet_PwrSetup::_pd_prev_val(){
     _voption = _pd_voltage.cend();
   _voption = std::prev(_voption);
   _volts_pd = *_voption;
-  EVT_POST_DATA(IRON_SET_EVT, e2int(iron_t::pdVoltage), &_volts_pd, sizeof(_volts_pd));
+  evt::post<iron_t::pdVoltage>(IRON_SET_EVT, _volts_pd);
 }
 
 void ViSet_PwrSetup::_qc_mode_toggle(bool mode){
@@ -1260,7 +1193,7 @@ void ViSet_PwrSetup::_qc_voltage_step(bool inc){
     _volts_qc = muipp::clamp(inc ? ++_volts_qc : --_volts_qc, (uint32_t)5, (uint32_t)20);
   }
   // send volage change cmd
-  EVT_POST_DATA(IRON_SET_EVT, e2int(iron_t::qcVoltage), &_volts_qc, sizeof(_volts_qc));
+  evt::post<iron_t::qcVoltage>(IRON_SET_EVT, _volts_qc);
 }
 
 
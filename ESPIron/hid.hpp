@@ -13,7 +13,7 @@
 #include <mutex>
 #include <sstream>
 #include "common.hpp"
-#include "evtloop.hpp"
+#include "evtreg.hpp"
 #include "espasyncbutton.hpp"
 #include "muipp_u8g2.hpp"
 #include "lang/lang_en_us.h"
@@ -170,9 +170,7 @@ class ViSet_MainScreen : public VisualSet {
   // input voltage
   uint32_t _vin{0};
 
-  esp_event_handler_instance_t _evt_snsr_handler = nullptr;
   esp_event_handler_instance_t _evt_ntfy_handler = nullptr;
-  esp_event_handler_instance_t _evt_set_handler = nullptr;
   esp_event_handler_instance_t _evt_state_handler = nullptr;
 
   // event dispatcher
@@ -183,17 +181,21 @@ class ViSet_MainScreen : public VisualSet {
   // encoder events picker
   void _evt_encoder(ESPButton::event_t e, const EventMsg* m) override;
 
-  // sensor events handler
-  void _evt_sensor(int32_t id, void* data);
+  // notify events handler, iron controller mode changes
+  template <ironState_t S>
+  void _evt_mode(){ _state = S; }
 
-  // notify events handler
-  void _evt_notify(int32_t id, void* data);
+  // state events handler, working temperature reply
+  void _evt_work_temp(int32_t t);
 
-  // command events handler
-  void _evt_cmd(int32_t id, void* data);
-
-  // state events handler
-  void _evt_state(int32_t id, void* data);
+  using _ntfy_table = evt::Dispatcher<ViSet_MainScreen,
+    evt::on<evt::iron_t::stateWorking, &ViSet_MainScreen::_evt_mode<ironState_t::working>>,
+    evt::on<evt::iron_t::stateStandby, &ViSet_MainScreen::_evt_mode<ironState_t::standby>>,
+    evt::on<evt::iron_t::stateIdle, &ViSet_MainScreen::_evt_mode<ironState_t::idle>>,
+    evt::on<evt::iron_t::stateBoost, &ViSet_MainScreen::_evt_mode<ironState_t::boost>>,
+    evt::on<evt::iron_t::statePWRRampStart, &ViSet_MainScreen::_evt_mode<ironState_t::ramping>>,
+    evt::on<evt::iron_t::statePWRRampCmplt, &ViSet_MainScreen::_evt_mode<ironState_t::working>>
+  >;
 
 public:
   ViSet_MainScreen(GPIOButton<ESPEventPolicy> &button, PseudoRotaryEncoder &encoder);
@@ -322,8 +324,9 @@ class ViSet_PwrSetup : public MuiMenu {
   // selected PD/QC voltage
   uint32_t _volts_pd{5};
   uint32_t _volts_qc{5};
-  // current Vin voltage from sensor
+  // current Vin voltage from sensor and it's mailbox version
   uint32_t _vin{5};
+  uint32_t _vin_ver{0};
   // selected QC mode (index for menu_QCFunctionOpts array)
   uint32_t _qc_mode{0};
 
@@ -335,8 +338,6 @@ class ViSet_PwrSetup : public MuiMenu {
   // curent Vin value from a sensor
   std::string _vin_s;
 
-  esp_event_handler_instance_t _evt_snsr_handler = nullptr;
-
   // menu builder function
   void _buildMenu();
 
@@ -358,6 +359,9 @@ public:
   // d-tor
   ~ViSet_PwrSetup();
 
+  // refresh screen on updated Vin value
+  void drawScreen() override;
+
 };
 
 class ViSet_USBMSC : public MuiMenu {
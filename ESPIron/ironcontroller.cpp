@@ -53,17 +53,17 @@ void deep_sleep(TimerHandle_t h){
 IronController::~IronController(){
   // unsubscribe from event bus
   if (_evt_sensor_handler){
-    esp_event_handler_instance_unregister_with(evt::get_hndlr(), SENSOR_DATA, ESP_EVENT_ANY_ID, _evt_sensor_handler);
+    evt::unsubscribe(SENSOR_DATA, e2int(iron_t::motion), _evt_sensor_handler);
     _evt_sensor_handler = nullptr;
   }
 
   if (_evt_cmd_handler){
-    esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_SET_EVT, ESP_EVENT_ANY_ID, _evt_cmd_handler);
+    _cmd_table::unsubscribe(IRON_SET_EVT, _evt_cmd_handler);
     _evt_cmd_handler = nullptr;
   }
 
   if (_evt_req_handler){
-    esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_GET_EVT, ESP_EVENT_ANY_ID, _evt_req_handler);
+    _req_table::unsubscribe(IRON_GET_EVT, _evt_req_handler);
     _evt_req_handler = nullptr;
   }
 
@@ -91,7 +91,9 @@ void IronController::init(){
                               pdMS_TO_TICKS(MODE_TIMER_PERIOD),
                               pdTRUE,
                               static_cast<void*>(this),
-                              [](TimerHandle_t h) { static_cast<IronController*>(pvTimerGetTimerID(h))->_mode_switcher(); }
+                              // mode switching runs in event loop, timer service task must not wait on a full queue,
+                              // a dropped tick is made up by the next one
+                              [](TimerHandle_t) { evt::post<iron_t::modeTick>(evt::post_policy_t::coalesce, IRON_SET_EVT); }
                             );
     if (_tmr_mode)
       xTimerStart( _tmr_mode, portMAX_DELAY );
@@ -99,15 +101,15 @@ void IronController::init(){
 
   // event bus subscriptions
   if (!_evt_sensor_handler){
-    ESP_ERROR_CHECK(esp_event_handler_instance_register_with(evt::get_hndlr(), SENSOR_DATA, ESP_EVENT_ANY_ID, IronController::_event_hndlr, this, &_evt_sensor_handler));
+    ESP_ERROR_CHECK(evt::subscribe<iron_t::motion, &IronController::_evt_motion>(SENSOR_DATA, this, &_evt_sensor_handler));
   }
 
   if (!_evt_cmd_handler){
-    ESP_ERROR_CHECK(esp_event_handler_instance_register_with(evt::get_hndlr(), IRON_SET_EVT, ESP_EVENT_ANY_ID, IronController::_event_hndlr, this, &_evt_cmd_handler));
+    ESP_ERROR_CHECK(_cmd_table::subscribe(IRON_SET_EVT, this, &_evt_cmd_handler));
   }
 
   if (!_evt_req_handler){
-    ESP_ERROR_CHECK(esp_event_handler_instance_register_with(evt::get_hndlr(), IRON_GET_EVT, ESP_EVENT_ANY_ID, IronController::_event_hndlr, this, &_evt_req_handler));
+    ESP_ERROR_CHECK(_req_table::subscribe(IRON_GET_EVT, this, &_evt_req_handler));
   }
 
 
@@ -131,6 +133,8 @@ void IronController::init(){
 
   if (qc_mode)
     _qc = std::make_unique<QC3ControlWA>(qc_mode, qcv);
+
+  _post_power_budget();
 }
 
 void IronController::_mode_switcher(){
@@ -142,9 +146,9 @@ void IronController::_mode_switcher(){
         _state = ironState_t::standby;
         LOGI(T_CTRL, printf, "Engage standby mode due to sleep timeout of %u ms. Temp:%u\n", _timeout.standby, _temp.standby);
         // switch heater temperature to standby value
-        EVT_POST_DATA(IRON_HEATER, e2int(iron_t::heaterTargetT), &_temp.standby, sizeof(_temp.standby));
+        evt::post<iron_t::heaterTargetT>(IRON_HEATER, _temp.standby);
         // notify other componets that we are switching to 'standby' mode
-        EVT_POST(IRON_NOTIFY, e2int(iron_t::stateStandby));
+        evt::post<iron_t::stateStandby>(IRON_NOTIFY);
       }
       return;
     }
@@ -155,19 +159,19 @@ void IronController::_mode_switcher(){
         _xTicks.idle = xTaskGetTickCount();
         LOGI(T_CTRL, printf, "Engage idle mode due to idle timeout of %u ms\n", _timeout.idle);
         // notify other componets that we are switching to 'idle' mode
-        EVT_POST(IRON_NOTIFY, e2int(iron_t::stateIdle));
+        evt::post<iron_t::stateIdle>(IRON_NOTIFY);
         // disable heater
-        EVT_POST(IRON_HEATER, e2int(iron_t::heaterDisable));
+        evt::post<iron_t::heaterDisable>(IRON_HEATER);
       } else if (pdTICKS_TO_MS(xTaskGetTickCount()) - pdTICKS_TO_MS(_xTicks.motion) < _timeout.standby){
         // standby cancelled
         _state = ironState_t::working;
         LOGI(T_CTRL, println, "cancel Standby mode");
         // notify other componets that we are switching to 'work' mode
-        EVT_POST(IRON_NOTIFY, e2int(iron_t::stateWorking));
+        evt::post<iron_t::stateWorking>(IRON_NOTIFY);
         // switch on heater
-        EVT_POST(IRON_HEATER, e2int(iron_t::heaterEnable));
+        evt::post<iron_t::heaterEnable>(IRON_HEATER);
         // set target T for heater
-        EVT_POST_DATA(IRON_HEATER, e2int(iron_t::heaterTargetT), &_temp.working, sizeof(_temp.working));
+        evt::post<iron_t::heaterTargetT>(IRON_HEATER, _temp.working);
       }
       return;
     }
@@ -181,7 +185,7 @@ void IronController::_mode_switcher(){
         if (_tmr_mode)
           xTimerStop(_tmr_mode, portMAX_DELAY );
         // notify other components that we are switching to 'suspend' mode
-        EVT_POST(IRON_NOTIFY, e2int(iron_t::stateSuspend));
+        evt::post<iron_t::stateSuspend>(IRON_NOTIFY);
         // give some time for other components to prepare for deep sleep, then suspend the controller
         TimerHandle_t timer = xTimerCreate(NULL,
                               pdMS_TO_TICKS(DEEPSLEEP_DELAY),
@@ -200,14 +204,15 @@ void IronController::_mode_switcher(){
       if (t > _timeout.boost){
         _state = ironState_t::working;
         // notify other componets that we are switching to 'working' mode
-        EVT_POST(IRON_NOTIFY, e2int(iron_t::stateWorking));
+        evt::post<iron_t::stateWorking>(IRON_NOTIFY);
         LOGI(T_CTRL, printf, "Engage work mode due to boost timeout of %u ms\n", _timeout.boost);
         // set target T for heater
-        EVT_POST_DATA(IRON_HEATER, e2int(iron_t::heaterTargetT), &_temp.working, sizeof(_temp.working));
+        evt::post<iron_t::heaterTargetT>(IRON_HEATER, _temp.working);
       } else {
         // send notification with time left till boost is disabled (in seconds)
-        unsigned time_left = _timeout.boost - t; 
-        EVT_POST_DATA(IRON_NOTIFY, e2int(iron_t::stateBoost), &time_left, sizeof(time_left));
+        uint32_t time_left = _timeout.boost - t;
+        // countdown, only the latest value matters
+        evt::post<iron_t::stateBoost>(evt::post_policy_t::coalesce, IRON_NOTIFY, time_left);
       }
     }
 
@@ -215,192 +220,134 @@ void IronController::_mode_switcher(){
   }
 }
 
-void IronController::_event_hndlr(void* handler, esp_event_base_t base, int32_t id, void* event_data){
-  CTRL_LOGV(printf, "EVENT %s:%d\n", base, id);
-  if ( base == SENSOR_DATA )
-    return static_cast<IronController*>(handler)->_evt_sensors(base, id, event_data);
-
-  if ( base == IRON_SET_EVT )
-    return static_cast<IronController*>(handler)->_evt_commands(base, id, event_data);
-
-  if ( base == IRON_GET_EVT )
-    return static_cast<IronController*>(handler)->_evt_reqs(base, id, event_data);
+void IronController::_evt_motion(){
+  // update motion detect timestamp
+  _xTicks.motion = xTaskGetTickCount();
 }
 
-void IronController::_evt_sensors(esp_event_base_t base, int32_t id, void* data){
-  switch (static_cast<evt::iron_t>(id)){
-    case evt::iron_t::motion :
-      // update motion detect timestamp
+void IronController::_evt_work_toggle(){
+  // switch working mode on/off
+  switch (_state){
+    case ironState_t::idle :
+    case ironState_t::standby :
+      // switch to working mode
+      _state = ironState_t::working;
+      // reset motion timer
       _xTicks.motion = xTaskGetTickCount();
-  }
-}
-
-// process command events
-void IronController::_evt_commands(esp_event_base_t base, int32_t id, void* data){
-  switch (static_cast<evt::iron_t>(id)){
-
-    // toggle working mode
-    case evt::iron_t::workModeToggle : {
-      // switch working mode on/off
-      switch (_state){
-        case ironState_t::idle :
-        case ironState_t::standby :
-          // switch to working mode
-          _state = ironState_t::working;
-          // reset motion timer
-          _xTicks.motion = xTaskGetTickCount();
-          // notify other components
-          LOGI(T_CTRL, println, "switch to working mode");
-          // set heater to work temperature
-          EVT_POST_DATA(IRON_HEATER, e2int(iron_t::heaterTargetT), &_temp.working, sizeof(_temp.working));
-          // enable heater either with PWM ramping or plain
-          EVT_POST(IRON_HEATER, _pwm_ramp ? e2int(iron_t::heaterRampUp) : e2int(iron_t::heaterEnable));
-          EVT_POST(IRON_NOTIFY, _pwm_ramp ? e2int(iron_t::statePWRRampStart) : e2int(iron_t::stateWorking));     // mode change notification
-          break;
-
-        case ironState_t::boost :
-        case ironState_t::working :
-          // switch to idle mode
-          _state = ironState_t::idle;
-          // reset idle timer
-          _xTicks.idle = xTaskGetTickCount();
-          // notify other components
-          LOGI(T_CTRL, println, "switch to Idle mode");
-          EVT_POST(IRON_HEATER, e2int(iron_t::heaterDisable));
-          EVT_POST(IRON_NOTIFY, e2int(iron_t::stateIdle));        // mode change notification
-          break;
-/*
-        // iron was suspended, wake up
-        case ironState_t::suspend :
-          _state = ironState_t::idle;
-          // reset idle timer
-          _xTicks.idle = xTaskGetTickCount();
-          // start mode switcher timer
-          if (_tmr_mode) xTimerStart( _tmr_mode, portMAX_DELAY );
-          break;
-*/
-      }
-      break;
-    }
-
-    // toggle boost mode
-    case evt::iron_t::boostModeToggle : {
-      switch (_state){
-        case ironState_t::working : {
-          // switch to boost mode
-          _state = ironState_t::boost;
-          // notify other components
-          LOGI(T_CTRL, println, "switch to Boost mode");
-          EVT_POST_DATA(IRON_NOTIFY, e2int(iron_t::stateBoost), &_timeout.boost, sizeof(_timeout.boost));
-          // set heater to boost temperature
-          int32_t t = _temp.working + _temp.boost;
-          EVT_POST_DATA(IRON_HEATER, e2int(iron_t::heaterTargetT), &t, sizeof(t));
-          _xTicks.boost = xTaskGetTickCount();
-          break;
-        }
-
-        case ironState_t::boost :
-          // switch to idle mode
-          _state = ironState_t::working;
-          // notify other components
-          LOGI(T_CTRL, println, "switch to Work mode");
-          EVT_POST(IRON_NOTIFY, e2int(iron_t::stateWorking));
-          EVT_POST_DATA(IRON_HEATER, e2int(iron_t::heaterTargetT), &_temp.working, sizeof(_temp.working));
-          break;
+      // notify other components
+      LOGI(T_CTRL, println, "switch to working mode");
+      // set heater to work temperature
+      evt::post<iron_t::heaterTargetT>(IRON_HEATER, _temp.working);
+      // enable heater either with PWM ramping or plain, mode change notification
+      if (_pwm_ramp){
+        evt::post<iron_t::heaterRampUp>(IRON_HEATER);
+        evt::post<iron_t::statePWRRampStart>(IRON_NOTIFY);
+      } else {
+        evt::post<iron_t::heaterEnable>(IRON_HEATER);
+        evt::post<iron_t::stateWorking>(IRON_NOTIFY);
       }
       break;
-    }
 
-    // direction to switch to idle mode (from HID menu selector)
-    case iron_t::stateIdle : {
+    case ironState_t::boost :
+    case ironState_t::working :
       // switch to idle mode
+      _evt_idle();
+      break;
+/*
+    // iron was suspended, wake up
+    case ironState_t::suspend :
       _state = ironState_t::idle;
       // reset idle timer
       _xTicks.idle = xTaskGetTickCount();
-      // notify other components
-      LOGI(T_CTRL, println, "switch to Idle mode");
-      EVT_POST(IRON_HEATER, e2int(iron_t::heaterDisable));
-      EVT_POST(IRON_NOTIFY, e2int(iron_t::stateIdle));
+      // start mode switcher timer
+      if (_tmr_mode) xTimerStart( _tmr_mode, portMAX_DELAY );
       break;
-    }
+*/
+    default:;
+  }
+}
 
-    // set work temperature (arrive from HID)
-    case evt::iron_t::workTemp : {
-      int32_t t = *reinterpret_cast<int32_t*>(data);
-      if (t != _temp.working){
-        _temp.working = *reinterpret_cast<int32_t*>(data);
-        // save new working temp to NVS only if respective flag is set
-        if (_temp.savewrk)
-          nvs_blob_write(T_IRON, T_temperatures, static_cast<void*>(&_temp), sizeof(Temperatures));
-      }
-      if (_state == ironState_t::working)
-        EVT_POST_DATA(IRON_HEATER, e2int(iron_t::heaterTargetT), &_temp.working, sizeof(_temp.working));
+void IronController::_evt_boost_toggle(){
+  switch (_state){
+    case ironState_t::working : {
+      // switch to boost mode
+      _state = ironState_t::boost;
+      // notify other components
+      LOGI(T_CTRL, println, "switch to Boost mode");
+      uint32_t time_left = _timeout.boost;
+      evt::post<iron_t::stateBoost>(IRON_NOTIFY, time_left);
+      // set heater to boost temperature
+      int32_t t = _temp.working + _temp.boost;
+      evt::post<iron_t::heaterTargetT>(IRON_HEATER, t);
+      _xTicks.boost = xTaskGetTickCount();
       break;
     }
 
-    // reload temp configuration
-    case evt::iron_t::reloadTemp : {
-      LOGV(T_HID, println, "reload temp settings");
-      // load temperature values from NVS
-      nvs_blob_read(T_IRON, T_temperatures, static_cast<void*>(&_temp), sizeof(Temperatures));
-
-      // if we are not saving working temp, then use default one instead
-      if (!_temp.savewrk)
-        _temp.working = _temp.deflt;
+    case ironState_t::boost :
+      // switch to idle mode
+      _state = ironState_t::working;
+      // notify other components
+      LOGI(T_CTRL, println, "switch to Work mode");
+      evt::post<iron_t::stateWorking>(IRON_NOTIFY);
+      evt::post<iron_t::heaterTargetT>(IRON_HEATER, _temp.working);
       break;
-    }
 
-    // reload temp timers
-    case evt::iron_t::reloadTimeouts :
-      LOGV(T_HID, println, "reload timers settings");
-      // load timeout values from NVS
-      nvs_blob_read(T_IRON, T_timeouts, static_cast<void*>(&_timeout), sizeof(IronTimeouts));
-      break;
+    default:;
+  }
+}
 
-    // adjust PD trigger (arrive from HID)
-    case evt::iron_t::pdVoltage :
-      _pd_trigger(*reinterpret_cast<int32_t*>(data));
-      break;
+void IronController::_evt_idle(){
+  // switch to idle mode
+  _state = ironState_t::idle;
+  // reset idle timer
+  _xTicks.idle = xTaskGetTickCount();
+  // notify other components
+  LOGI(T_CTRL, println, "switch to Idle mode");
+  evt::post<iron_t::heaterDisable>(IRON_HEATER);
+  evt::post<iron_t::stateIdle>(IRON_NOTIFY);        // mode change notification
+}
 
-    // adjust QC trigger voltage (arrive from HID)
-    case evt::iron_t::qcVoltage :
-      if(_qc) _qc->setQCV (*reinterpret_cast<uint32_t*>(data));
-      break;
+void IronController::_evt_work_temp(int32_t t){
+  if (t != _temp.working){
+    _temp.working = t;
+    // save new working temp to NVS only if respective flag is set
+    if (_temp.savewrk)
+      nvs_blob_write(T_IRON, T_temperatures, static_cast<void*>(&_temp), sizeof(Temperatures));
+  }
+  if (_state == ironState_t::working)
+    evt::post<iron_t::heaterTargetT>(IRON_HEATER, _temp.working);
+}
 
-    // PWM ramp control
-    case evt::iron_t::enablePWMRamp :
-      _pwm_ramp = true;
-      break;
+void IronController::_evt_reload_temp(){
+  LOGV(T_HID, println, "reload temp settings");
+  // load temperature values from NVS
+  nvs_blob_read(T_IRON, T_temperatures, static_cast<void*>(&_temp), sizeof(Temperatures));
 
-    case evt::iron_t::disablePWMRamp :
-      _pwm_ramp = false;
-      break;
+  // if we are not saving working temp, then use default one instead
+  if (!_temp.savewrk)
+    _temp.working = _temp.deflt;
+}
 
-/*
-    // switch QC trigger modes
-    case evt::iron_t::qcDisable :
-      _qc_trigger_init(0);
-      break;
-    case evt::iron_t::qc3enable :
-      _qc_trigger_init(1);
-      break;
-    case evt::iron_t::qc2enable :
-      _qc_trigger_init(2);
-      break;
-*/
-    // some
-  }
+void IronController::_evt_reload_timeouts(){
+  LOGV(T_HID, println, "reload timers settings");
+  // load timeout values from NVS
+  nvs_blob_read(T_IRON, T_timeouts, static_cast<void*>(&_timeout), sizeof(IronTimeouts));
+}
 
+void IronController::_evt_pd_voltage(uint32_t v){
+  _voltage = v;
+  _pd_trigger(_voltage);
+  _post_power_budget();
 }
 
-void IronController::_evt_reqs(esp_event_base_t base, int32_t id, void* data){
-  switch (static_cast<evt::iron_t>(id)){
+void IronController::_evt_qc_voltage(uint32_t v){
+  if (!_qc) return;
+  _qc->setQCV(v);
+  _post_power_budget();
+}
 
-    // req for working temperature
-    case iron_t::workTemp :
-      EVT_POST_DATA(IRON_STATE, e2int(iron_t::workTemp), &_temp.working, sizeof(_temp.working));
-      break;
-  }
+void IronController::_evt_req_work_temp(){
+  evt::post<iron_t::workTemp>(IRON_STATE, _temp.working);
 }
 
 void IronController::_pd_trigger_init(){
@@ -447,6 +394,12 @@ void IronController::_pd_trigger(uint32_t voltage){
 
 
 
+void IronController::_post_power_budget(){
+  // QC trigger takes precedence if enabled
+  evt::PowerBudget b = _qc ? evt::PowerBudget{ _qc->getQCV() * 1000, QC_CURRENT_LIMIT } : evt::PowerBudget{ _voltage * 1000, PD_CURRENT_LIMIT };
+  evt::post<iron_t::heaterPowerBudget>(IRON_HEATER, b);
+}
+
 QC3ControlWA::QC3ControlWA(uint32_t mode, uint32_t voltage) : QC3Control(QC_DP_PIN, QC_DM_PIN), qc_mode(mode), qcv(voltage) {
   uint32_t wait_time = QC_T_GLITCH_BC_DONE_MS + 100;  // without this extra 100ms some PSUs does not work properly
   // for QC2 mode increase wait time twice, those powerbanks I have in my posession needs much more significant delay
@@ -479,6 +432,7 @@ void QC3ControlWA::_start(){
 }
 
 void QC3ControlWA::setQCV(uint32_t V){
+  qcv = V;
   //LOGD(T_CTRL, print, "set QC volts:\n");
   //_qc->setMilliVoltage(volt*1000);
   if (qc_mode == 1)
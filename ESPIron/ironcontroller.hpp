@@ -10,7 +10,7 @@
     (at your option) any later version.
 */
 #pragma once
-#include "evtloop.hpp"
+#include "evtreg.hpp"
 #include "common.hpp"
 #include "const.h"
 #include "nvs.hpp"
@@ -63,23 +63,32 @@ class IronController {
   std::unique_ptr<QC3ControlWA> _qc;
 
   /**
-   * @brief timer callback that watches mode switching
+   * @brief mode switcher, runs on modeTick event posted by mode timer
    * it maintains timeouts for sleep, off, boost modes, etc...
-   * 
+   * it runs in event loop same as other command handlers, so heater commands it posts wait for the queue and are never dropped
    */
   void _mode_switcher();
 
-  // event bus messages dispatcher
-  static void _event_hndlr(void* handler, esp_event_base_t base, int32_t id, void* event_data);
-
-  // sensors events executor
-  void _evt_sensors(esp_event_base_t base, int32_t id, void* data);
-
-  // commands events executor
-  void _evt_commands(esp_event_base_t base, int32_t id, void* data);
-
-  // req commands events executor
-  void _evt_reqs(esp_event_base_t base, int32_t id, void* data);
+  // sensors events executors
+  void _evt_motion();
+
+  // commands events executors
+  void _evt_work_toggle();
+  void _evt_boost_toggle();
+  // direction to switch to idle mode (from HID menu selector)
+  void _evt_idle();
+  // set work temperature (arrive from HID)
+  void _evt_work_temp(int32_t t);
+  void _evt_reload_temp();
+  void _evt_reload_timeouts();
+  // adjust PD/QC trigger voltage (arrive from HID)
+  void _evt_pd_voltage(uint32_t v);
+  void _evt_qc_voltage(uint32_t v);
+  template <bool On>
+  void _evt_pwm_ramp(){ _pwm_ramp = On; }
+
+  // req commands events executors
+  void _evt_req_work_temp();
 
 public:
   //IronController() : _qcc(QC_DP_PIN, QC_DM_PIN) {}
@@ -128,6 +137,33 @@ private:
    * 
    */
   void _pd_trigger_init();
+
+  /**
+   * @brief publish supply contract for active PD/QC trigger to heater
+   * heater caps it's duty to keep supply current within the limit
+   */
+  void _post_power_budget();
+
+  // commands dispatch table
+  using _cmd_table = evt::Dispatcher<IronController,
+    evt::on<evt::iron_t::workModeToggle, &IronController::_evt_work_toggle>,
+    evt::on<evt::iron_t::boostModeToggle, &IronController::_evt_boost_toggle>,
+    evt::on<evt::iron_t::modeTick, &IronController::_mode_switcher>,
+    evt::on<evt::iron_t::stateIdle, &IronController::_evt_idle>,
+    evt::on<evt::iron_t::workTemp, &IronController::_evt_work_temp>,
+    evt::on<evt::iron_t::reloadTemp, &IronController::_evt_reload_temp>,
+    evt::on<evt::iron_t::reloadTimeouts, &IronController::_evt_reload_timeouts>,
+    evt::on<evt::iron_t::pdVoltage, &IronController::_evt_pd_voltage>,
+    evt::on<evt::iron_t::qcVoltage, &IronController::_evt_qc_voltage>,
+    evt::on<evt::iron_t::enablePWMRamp, &IronController::_evt_pwm_ramp<true>>,
+    evt::on<evt::iron_t::disablePWMRamp, &IronController::_evt_pwm_ramp<false>>
+  >;
+
+  // requests dispatch table
+  using _req_table = evt::Dispatcher<IronController,
+    evt::on<evt::iron_t::workTemp, &IronController::_evt_req_work_temp>,
+    evt::on<evt::iron_t::heaterPowerBudget, &IronController::_post_power_budget>
+  >;
 };
 
 /**
@@ -149,5 +185,8 @@ public:
   virtual ~QC3ControlWA();
 
   void setQCV(uint32_t V);
+
+  // get requested QC voltage, V
+  uint32_t getQCV() const { return qcv; }
 };
 
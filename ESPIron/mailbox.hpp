@@ -0,0 +1,76 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+/**
+ * Latest value channels
+ * no Arduino/IDF dependencies, could be built for the host as well
+ */
+namespace mbox {
+
+/**
+ * @brief latest value mailbox
+ * a single producer overwrites the value, any number of consumers read the latest one on demand,
+ * neither side ever blocks. Value is double buffered, producer writes the slot that is not published,
+ * so a consumer that preempts producer in the middle of a write still gets previous complete value.
+ * Consumer retries if producer has published while the value was being copied
+ *
+ * @tparam T trivially copyable value type
+ */
+template <typename T>
+class Mailbox {
+  static_assert(std::is_trivially_copyable_v<T>, "mailbox value must be trivially copyable");
+
+  // number of values published, the latest one is in _v[_seq & 1]
+  std::atomic<uint32_t> _seq{0};
+  T _v[2]{};
+
+public:
+  /**
+   * @brief publish a new value, must be called from a single producer
+   */
+  void publish(const T& v){
+    uint32_t n = _seq.load(std::memory_order_relaxed) + 1;
+    // previous publish must be visible before it's consumers' slot is reused on next one
+    std::atomic_thread_fence(std::memory_order_release);
+    _v[n & 1] = v;
+    _seq.store(n, std::memory_order_release);
+  }
+
+  /**
+   * @brief read the latest value
+   *
+   * @param v value, not changed if nothing has been published yet
+   * @return uint32_t version of the value, it grows with each publish, 0 if nothing has been published yet
+   */
+  uint32_t read(T& v) const {
+    for (;;){
+      uint32_t n = _seq.load(std::memory_order_acquire);
+      if (!n) return 0;
+      T copy = _v[n & 1];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // slot is overwritten only on publish n+2, which is preceded by n+1
+      if (_seq.load(std::memory_order_relaxed) == n){
+        v = copy;
+        return n;
+      }
+    }
+  }
+
+  // version of the latest value, 0 if nothing has been published yet
+  uint32_t version() const { return _seq.load(std::memory_order_acquire); }
+};
+
+} // namespace mbox
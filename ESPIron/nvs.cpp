@@ -32,7 +32,7 @@ esp_err_t nvs_blob_read(const char* nvsspace, const char* key, void* blob, size_
   return err;
 }
 
-esp_err_t nvs_blob_write(const char* nvsspace, const char* key, void* blob, size_t len){
+esp_err_t nvs_blob_write(const char* nvsspace, const char* key, const void* blob, size_t len){
   esp_err_t err;
   std::unique_ptr<nvs::NVSHandle> nvs = nvs::open_nvs_handle(nvsspace, NVS_READWRITE, &err);
 
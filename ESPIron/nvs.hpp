@@ -17,5 +17,5 @@
 
 esp_err_t nvs_blob_read(const char* nvsspace, const char* key, void* blob, size_t len);
 
-esp_err_t nvs_blob_write(const char* nvsspace, const char* key, void* blob, size_t len);
+esp_err_t nvs_blob_write(const char* nvsspace, const char* key, const void* blob, size_t len);
 
@@ -0,0 +1,204 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <cmath>
+#include <utility>
+
+#define PID_SCHEDULE_POINTS       4                     // max number of gain schedule points
+#define PID_DERIVATIVE_N          8                     // derivative filter, max derivative gain at high frequencies is N*Kp
+
+/**
+ * PID controller
+ * no Arduino/IDF dependencies, could be built for the host and run against thermalsim::TipPlant
+ */
+namespace pid {
+
+template <typename T>
+struct Gains {
+  T kp;     // proportional gain, output units per input unit
+  T ki;     // integral gain, output units per input unit per second
+  T kd;     // derivative gain, output units per input unit per second of change
+};
+
+/**
+ * @brief gains scheduled by setpoint
+ * gains are linearly interpolated between points and kept constant beyond the first and the last one
+ */
+template <typename T, size_t N = PID_SCHEDULE_POINTS>
+struct Schedule {
+  struct Point {
+    T sp;           // setpoint gains are tuned at
+    Gains<T> g;
+  };
+
+  // number of valid points
+  uint8_t n;
+  // points sorted by setpoint
+  std::array<Point, N> p;
+
+  /**
+   * @brief get gains for a setpoint
+   */
+  constexpr Gains<T> at(T sp) const {
+    if (!n) return Gains<T>{};
+    if (sp <= p[0].sp) return p[0].g;
+    if (sp >= p[n - 1].sp) return p[n - 1].g;
+    size_t i = 1;
+    while (sp > p[i].sp) ++i;
+    T s = (sp - p[i-1].sp) / (p[i].sp - p[i-1].sp);
+    const Gains<T> &a = p[i-1].g, &b = p[i].g;
+    return { a.kp + s * (b.kp - a.kp), a.ki + s * (b.ki - a.ki), a.kd + s * (b.kd - a.kd) };
+  }
+
+  /**
+   * @brief set gains for a setpoint
+   * a point closer than 'merge' to the setpoint is replaced, otherwise a new point is inserted,
+   * if schedule is full the nearest point is replaced
+   */
+  void set(T sp, const Gains<T>& g, T merge){
+    size_t nearest = 0;
+    for (size_t i = 1; i < n; ++i)
+      if (std::fabs(p[i].sp - sp) < std::fabs(p[nearest].sp - sp)) nearest = i;
+
+    if (n && (std::fabs(p[nearest].sp - sp) < merge || n == N)){
+      p[nearest] = {sp, g};
+      // replaced point could be out of order now
+      while (nearest && p[nearest - 1].sp > p[nearest].sp){ std::swap(p[nearest - 1], p[nearest]); --nearest; }
+      while (nearest + 1 < n && p[nearest + 1].sp < p[nearest].sp){ std::swap(p[nearest + 1], p[nearest]); ++nearest; }
+      return;
+    }
+
+    size_t i = n++;
+    for (; i && p[i - 1].sp > sp; --i) p[i] = p[i - 1];
+    p[i] = {sp, g};
+  }
+};
+
+/**
+ * @brief PID controller with
+ *  - derivative on measurement, setpoint changes do not kick the output
+ *  - first order derivative filter with time constant Td/N
+ *  - back-calculation anti-windup, saturated part of the output is fed back to the integrator
+ *    with tracking time constant sqrt(Ti*Td)
+ *  - bumpless transfer, integrator could be preset to take over from an externally applied output
+ * Loop period is passed on each step, so controller is not bound to a fixed rate
+ *
+ * @tparam T float, double or Fixed<> number, time constants are derived from gains in float when gains are set,
+ * a step takes only add, mul, div and compare
+ */
+template <typename T = float>
+class Controller {
+  Gains<T> _g{};
+  // derivative filter and anti-windup tracking time constants, sec
+  T _tf{0}, _tt{0};
+  T _out_min{0}, _out_max{1};
+  // integral and filtered derivative terms, previous measurement
+  T _i{0}, _d{0}, _y_prev{0};
+  bool _started{false};
+
+  T _clamp(T v) const { return v < _out_min ? _out_min : v > _out_max ? _out_max : v; }
+
+public:
+  Controller() = default;
+  explicit Controller(const Gains<T>& g){ setGains(g); }
+
+  void setGains(const Gains<T>& g){
+    _g = g;
+    float kp = static_cast<float>(g.kp), ki = static_cast<float>(g.ki), kd = static_cast<float>(g.kd);
+    float ti = kp > 0 && ki > 0 ? kp / ki : 0;
+    float td = kp > 0 ? kd / kp : 0;
+    _tf = T(td / PID_DERIVATIVE_N);
+    _tt = T(ti * td > 0 ? std::sqrt(ti * td) : ti);
+  }
+  const Gains<T>& gains() const { return _g; }
+
+  void setOutputRange(T min, T max){
+    _out_min = min;
+    _out_max = max;
+    _i = _clamp(_i);
+  }
+
+  /**
+   * @brief run controller step
+   *
+   * @param sp setpoint
+   * @param y measurement
+   * @param dt time since previous step, sec
+   * @return T controller output within output range
+   */
+  T step(T sp, T y, T dt){
+    if (!_started || !(dt > T(0))){
+      _y_prev = y;
+      _started = true;
+    }
+
+    T e = sp - y;
+    T p = _g.kp * e;
+
+    // D = -Kd*s / (1 + s*Td/N) on measurement, backward Euler
+    if (dt > T(0) || _tf > T(0))
+      _d = (_tf * _d - _g.kd * (y - _y_prev)) / (_tf + dt);
+    _y_prev = y;
+
+    T v = p + _i + _d;
+    T u = _clamp(v);
+
+    if (_g.ki > T(0)){
+      _i += _g.ki * e * dt;
+      if (_tt > T(0)) _i += (u - v) * dt / _tt;
+      else _i -= v - u;
+    } else
+      _i = T(0);
+
+    return u;
+  }
+
+  /**
+   * @brief preset integrator for bumpless transfer
+   * controller output on a next step with the same measurement would match given output
+   *
+   * @param sp setpoint
+   * @param y measurement
+   * @param u output applied while controller was not in charge
+   */
+  void track(T sp, T y, T u){
+    preset(_g.ki > T(0) ? _clamp(u) - _g.kp * (sp - y) : T(0), y);
+  }
+
+  /**
+   * @brief set integral term and take measurement as previous one
+   * next step has no derivative kick, it's output is integral plus proportional term for the error
+   *
+   * @param i integral term, i.e. output that holds process at setpoint
+   * @param y current measurement
+   */
+  void preset(T i, T y){
+    _d = T(0);
+    _y_prev = y;
+    _started = true;
+    _i = i;
+  }
+
+  // integral term
+  T integral() const { return _i; }
+
+  // clear controller state
+  void reset(){
+    _i = _d = T(0);
+    _started = false;
+  }
+};
+
+} // namespace pid
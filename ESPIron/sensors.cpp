@@ -13,7 +13,7 @@
 GyroSensor::~GyroSensor(){
   // unsubscribe from event bus
   if (_evt_set_handler){
-    esp_event_handler_instance_unregister_with(evt::get_hndlr(), IRON_SET_EVT, e2int(evt::iron_t::sensorsReload), _evt_set_handler);
+    evt::unsubscribe(IRON_SET_EVT, e2int(evt::iron_t::sensorsReload), _evt_set_handler);
     _evt_set_handler = nullptr;
   }
 
@@ -57,14 +57,8 @@ void GyroSensor::init(){
 
   // subscribe to event bus
   if (!_evt_set_handler){
-    esp_event_handler_instance_register_with(
-      evt::get_hndlr(),
-      IRON_SET_EVT,
-      e2int(evt::iron_t::sensorsReload),    // subscribe to 'sensorsReload command'
-      [](void* self, esp_event_base_t base, int32_t id, void* data) { static_cast<GyroSensor*>(self)->enable(); },    // trigger config and timers reload
-      this,
-      &_evt_set_handler
-    );
+    // subscribe to 'sensorsReload command', trigger config and timers reload
+    evt::subscribe<evt::iron_t::sensorsReload, &GyroSensor::enable>(IRON_SET_EVT, this, &_evt_set_handler);
   }
 
   // start sensor polling
@@ -169,7 +163,7 @@ void GyroSensor::_accel_poll(){
     LOGD(T_GYRO, println, "motion detected!");
     LOGV(T_GYRO, printf, "Th:%d, x:%u, y:%u, z:%u\n", varThreshold, var[0], var[1], var[2]);
     // post event with motion detect
-    EVT_POST(SENSOR_DATA, e2int(evt::iron_t::motion));
+    evt::post<evt::iron_t::motion>(evt::post_policy_t::coalesce, SENSOR_DATA);
   }
 }
 
@@ -222,8 +216,7 @@ void GyroSensor::_clear(){
 }
 
 void GyroSensor::_temperature_poll(){
-  float t =  getAccellTemp();
-  EVT_POST_DATA(SENSOR_DATA, e2int(evt::iron_t::acceltemp), &t, sizeof(t));
+  evt::latest::acceltemp.publish(getAccellTemp());
 }
 
 
@@ -252,8 +245,7 @@ void VinSensor::init(){
 /*
   // subscribe to event bus
   if (!_evt_set_handler){
-    esp_event_handler_instance_register_with(
-      evt::get_hndlr(),
+    evt::subscribe(
       IRON_SET_EVT,
       e2int(evt::iron_t::sensorsReload),    // subscribe to 'sensorsReload command'
       [](void* self, esp_event_base_t base, int32_t id, void* data) { static_cast<VinSensor*>(self)->enable(); },    // trigger config and timers reload
@@ -271,16 +263,21 @@ VinSensor::~VinSensor(){
 
 // get supply voltage in mV 得到以mV为单位的电源电压
 void VinSensor::_runner(){
-  uint32_t voltage = 0;
+  uint32_t voltage = 0, cnt = 0;
 
   for (uint32_t i = 0; i < 4; i++) {  // get 32 readings 得到32个读数
-    voltage += analogReadMilliVolts(VIN_PIN);
+    // ADC unit could be locked by tip sensor DMA capture, such reads return 0 and should be skipped
+    if (uint32_t v = analogReadMilliVolts(VIN_PIN)){
+      voltage += v;
+      ++cnt;
+    }
   }
-  voltage = voltage / 4 * 31.3f;    // not sure where this 31.3 comes from, need real schematics of this Iron
+  if (!cnt) return;
+  voltage = voltage / cnt * VIN_DIVIDER;
 
 
   ADC_LOGV(T_ADC, printf, "Vin: %d mV\n", voltage);
-  EVT_POST_DATA(SENSOR_DATA, e2int(evt::iron_t::vin), &voltage, sizeof(voltage));
+  evt::latest::vin.publish(voltage);
 
   //  some calibration calc
   //  // VIN_Ru = 100k, Rd_GND = 3.3K
@@ -2,7 +2,7 @@
 #include <array>
 #include "common.hpp"
 #include "SparkFun_LIS2DH12.h"          // https://github.com/sparkfun/SparkFun_LIS2DH12_Arduino_Library
-#include "evtloop.hpp"
+#include "evtreg.hpp"
 #include "freertos/timers.h"
 
 #define GYRO_ACCEL_SAMPLES 32
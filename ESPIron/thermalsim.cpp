@@ -0,0 +1,66 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#ifdef HEATER_SIM
+#include "esp_timer.h"
+#include "common.hpp"
+#include "const.h"
+#include "evtreg.hpp"
+#include "heater_hal.hpp"
+#include "log.h"
+
+#ifndef HEATER_SIM_VIN
+#define HEATER_SIM_VIN            20.0f                 // simulated supply voltage, V
+#endif
+
+namespace hal {
+
+SimIron sim;
+
+static thermalsim::PlantParams sim_params(){
+  thermalsim::PlantParams p;
+  p.vin = HEATER_SIM_VIN;
+  p.pwm_period_us = 1000000 / HEATER_FREQ;
+  p.duty_max = 1 << HEATER_RES;
+  return p;
+}
+
+SimIron::SimIron() : _plant(sim_params()) {}
+
+void SimIron::init(){
+  _plant.reset(esp_timer_get_time());
+  LOGW(T_SIM, printf, "Heater is running against simulated plant, Vin:%.1f V\n", _plant.params().vin);
+
+  if (_evt_handler) return;
+  _cmd_table::subscribe(IRON_HEATER, this, &_evt_handler);
+}
+
+void SimIron::_sync(){
+  int64_t now = esp_timer_get_time();
+
+  // (re)start heat-up tracking on each new target or heater enable
+  if (!_enabled)
+    _metrics.stop();
+  else if (_restart.exchange(false))
+    _metrics.start(now, _target, _plant.energy());
+
+  thermalsim::HeatupMetrics::Report r;
+  while (_plant.time() < now){
+    _plant.advance(_plant.time() + thermalsim::TipPlant::step_us < now ? _plant.time() + thermalsim::TipPlant::step_us : now);
+    if (_metrics.feed(_plant.time(), _plant.heaterTemp(), _plant.energy(), r)){
+      LOGI(T_SIM, printf, "heat-up to %dC: settle:%u ms, overshoot:%.1f C, ripple:%.1f C, energy:%.1f J\n",
+        _target.load(), r.settle_ms, r.overshoot, r.ripple, r.energy);
+    }
+  }
+}
+
+} // namespace hal
+#endif  // HEATER_SIM
@@ -0,0 +1,279 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+#include <cmath>
+
+/**
+ * Thermal plant model of an Iron's tip, heater and OpAmp sense chain
+ * it does not depend on any Arduino/IDF API, so it could be built for the host as well
+ * and used to run TipHeater's control logic against a reproducible plant instead of a real Iron
+ */
+namespace thermalsim {
+
+struct PlantParams {
+  float vin{20.0f};             // supply voltage, V
+  float r_heater{4.0f};         // heater resistance, Ohm
+  float c_heater{0.8f};         // heater element heat capacity, J/K
+  float c_tip{2.0f};            // tip heat capacity, J/K
+  float g_ht{1.5f};             // heater to tip thermal conductance, W/K
+  float g_amb{0.04f};           // tip to ambient losses, W/K
+  float t_amb{25.0f};           // ambient temperature, C
+  float opamp_tau_us{2000};     // sense OpAmp recovery time constant after heater switch-off, us
+  float opamp_rail_mv{3100};    // OpAmp output when saturated with heater voltage, mV
+  float open_mv{1200};          // OpAmp output with tip removed, mV (~650 C)
+  float noise_mv{3};            // ADC noise amplitude, mV
+  uint32_t pwm_period_us{5000}; // heater PWM period, us
+  uint32_t duty_max{256};       // PWM duty value that matches 100% power
+  float leak_share{0.3f};       // power share of a partially shorted MOSFET when stuck_on fault is injected
+};
+
+// faults that could be injected into plant model
+enum class fault_t {
+  none = 0,
+  open_heater,                  // heater element is broken, no power is delivered
+  stuck_on,                     // MOSFET is partially shorted, heater is powered regardless of PWM duty
+  sensor_stuck                  // OpAmp output is frozen
+};
+
+/**
+ * @brief lumped two-node thermal plant
+ * heater node is heated with PWM power and holds the thermocouple,
+ * tip node is coupled to the heater and looses heat to ambient and to an optional external load
+ */
+class TipPlant {
+  PlantParams _p;
+  // node temperatures, C
+  float _t_heater, _t_tip;
+  // external heat sink conductance (i.e. tip touching a copper pour), W/K
+  float _g_load{0};
+  // energy spent since model reset, J
+  float _energy{0};
+
+  uint32_t _duty{0};
+  // model time, us
+  int64_t _now{0};
+  // PWM timer origin, i.e. the start of a PWM period
+  int64_t _pwm_origin{0};
+  // time when heater has been switched off last time
+  int64_t _t_off{0};
+  // PRNG state for ADC noise, fixed seed to keep runs reproducible
+  uint32_t _rnd{0x1234567};
+
+  fault_t _fault{fault_t::none};
+  // tip is inserted, removed tip leaves heater and sensor open
+  bool _tip{true};
+  // OpAmp output value frozen by sensor_stuck fault
+  float _stuck_mv{0};
+
+  float _noise(){
+    _rnd ^= _rnd << 13; _rnd ^= _rnd >> 17; _rnd ^= _rnd << 5;
+    return (static_cast<float>(_rnd % 2001) / 1000.0f - 1.0f) * _p.noise_mv;
+  }
+
+public:
+  // model integration step, us
+  static constexpr int64_t step_us = 1000;
+
+  explicit TipPlant(const PlantParams& p = PlantParams()) : _p(p), _t_heater(p.t_amb), _t_tip(p.t_amb) {}
+
+  const PlantParams& params() const { return _p; }
+
+  /**
+   * @brief reset model to ambient temperature
+   *
+   * @param now model time, us
+   */
+  void reset(int64_t now){ _t_heater = _t_tip = _p.t_amb; _energy = 0; _duty = 0; _now = _pwm_origin = _t_off = now; _fault = fault_t::none; _tip = true; }
+
+  /**
+   * @brief integrate plant state up to specified time
+   *
+   * @param now time, us
+   */
+  void advance(int64_t now){
+    while (_now < now){
+      int64_t dt_us = now - _now < step_us ? now - _now : step_us;
+      float dt = static_cast<float>(dt_us) * 1e-6f;
+      float pwr = power();
+      float q_ht = _p.g_ht * (_t_heater - _t_tip);
+      _t_heater += (pwr - q_ht) * dt / _p.c_heater;
+      _t_tip += (q_ht - (_p.g_amb + _g_load) * (_t_tip - _p.t_amb)) * dt / _p.c_tip;
+      _energy += pwr * dt;
+      _now += dt_us;
+    }
+  }
+
+  /**
+   * @brief set heater PWM duty
+   *
+   * @param duty
+   */
+  void setDuty(uint32_t duty){
+    if (_duty && !duty){
+      _t_off = _now;
+      // switched off within off-phase, OpAmp has been recovering since the falling edge
+      if (_duty < _p.duty_max){
+        int64_t phase = (_now - _pwm_origin) % _p.pwm_period_us;
+        int64_t t_on = static_cast<int64_t>(_p.pwm_period_us) * _duty / _p.duty_max;
+        if (phase > t_on) _t_off -= phase - t_on;
+      }
+    }
+    _duty = duty > _p.duty_max ? _p.duty_max : duty;
+  }
+
+  uint32_t getDuty() const { return _duty; }
+
+  // restart PWM period, same as resetting LEDC timer
+  void pwmRestart(){ _pwm_origin = _now; }
+
+  // set external thermal load conductance, W/K
+  void setLoad(float g){ _g_load = g; }
+
+  void setVin(float v){ _p.vin = v; }
+
+  // remove or insert tip, tip temperature is kept
+  void setTip(bool inserted){ _tip = inserted; }
+
+  // power share of a partially shorted MOSFET, 1 for a full short
+  void setLeak(float share){ _p.leak_share = share; }
+
+  /**
+   * @brief inject a fault into the model, fault persists until model reset
+   */
+  void injectFault(fault_t f){
+    // freeze settled OpAmp output for current heater temperature
+    if (f == fault_t::sensor_stuck) _stuck_mv = (_t_heater - 6.3959f) / 0.5378f;
+    _fault = f;
+  }
+
+  // average heater power, W
+  float power() const {
+    if (!_tip) return 0;
+    float share = static_cast<float>(_duty) / _p.duty_max;
+    switch (_fault){
+      case fault_t::open_heater : share = 0; break;
+      case fault_t::stuck_on : if (share < _p.leak_share) share = _p.leak_share; break;
+      default : break;
+    }
+    return _p.vin * _p.vin / _p.r_heater * share;
+  }
+
+  float tipTemp() const { return _t_tip; }
+  float heaterTemp() const { return _t_heater; }
+  float energy() const { return _energy; }
+  int64_t time() const { return _now; }
+
+  /**
+   * @brief OpAmp output voltage at current model time
+   * heater node temperature is converted back to mV with inverse of firmware's linear fit,
+   * while heater is powered OpAmp is saturated, after switch-off it recovers exponentialy
+   *
+   * @return float mV
+   */
+  float senseMilliVolts(){
+    // frozen OpAmp output is still sampled with ADC noise
+    if (_fault == fault_t::sensor_stuck) return _stuck_mv + _noise();
+    if (!_tip) return _p.open_mv + _noise();
+    float mv = (_t_heater - 6.3959f) / 0.5378f;
+    int64_t since_off;
+    if (_duty){
+      int64_t period = _p.pwm_period_us;
+      int64_t phase = (_now - _pwm_origin) % period;
+      int64_t t_on = period * _duty / _p.duty_max;
+      if (phase < t_on || _duty >= _p.duty_max) return _p.opamp_rail_mv;
+      since_off = phase - t_on;
+    } else
+      since_off = _now - _t_off;
+
+    mv += (_p.opamp_rail_mv - mv) * std::exp(-static_cast<float>(since_off) / _p.opamp_tau_us) + _noise();
+    return mv < 0 ? 0 : (mv > _p.opamp_rail_mv ? _p.opamp_rail_mv : mv);
+  }
+};
+
+/**
+ * @brief heat-up metrics collector
+ * tracks a transition to a new target temperature and reports
+ * settle time, overshoot, steady-state ripple and energy spent to reach the target
+ */
+class HeatupMetrics {
+public:
+  struct Report {
+    uint32_t settle_ms;     // time to enter and stay within tolerance band
+    float overshoot;        // max temperature excess past target in the direction of the step, C
+    float ripple;           // peak-to-peak temperature in steady state, C
+    float energy;           // energy spent until settled, J
+  };
+
+private:
+  float _target{0}, _band, _tmin, _tmax, _overshoot{0}, _e_start{0}, _e_settle{0};
+  // step direction, +1 for heat-up, -1 for cool-down, 0 until first feed
+  int _dir{0};
+  int64_t _start{0}, _in_band{-1}, _hold;
+  bool _running{false};
+
+public:
+  /**
+   * @param band tolerance band around target, C
+   * @param hold_ms time to stay in band to consider temperature settled
+   */
+  explicit HeatupMetrics(float band = 3.0f, uint32_t hold_ms = 5000) : _band(band), _hold(static_cast<int64_t>(hold_ms) * 1000) {}
+
+  bool running() const { return _running; }
+  float target() const { return _target; }
+
+  void start(int64_t now, float target, float energy){
+    _target = target; _start = now; _e_start = energy;
+    _in_band = -1; _overshoot = 0; _dir = 0; _running = true;
+  }
+
+  void stop(){ _running = false; }
+
+  /**
+   * @brief feed metrics with plant state
+   *
+   * @param now time, us
+   * @param t tip temperature
+   * @param energy energy counter, J
+   * @param r report to fill in
+   * @return true when heat-up has been completed and report is ready
+   */
+  bool feed(int64_t now, float t, float energy, Report& r){
+    if (!_running) return false;
+    // a step that starts within band is held, not approached from above
+    if (!_dir) _dir = t > _target + _band ? -1 : 1;
+    if ((t - _target) * _dir > _overshoot) _overshoot = (t - _target) * _dir;
+
+    if (std::fabs(t - _target) > _band){
+      _in_band = -1;
+      return false;
+    }
+
+    if (_in_band < 0){
+      _in_band = now; _e_settle = energy; _tmin = _tmax = t;
+      return false;
+    }
+
+    if (t < _tmin) _tmin = t;
+    if (t > _tmax) _tmax = t;
+    if (now - _in_band < _hold) return false;
+
+    r.settle_ms = static_cast<uint32_t>((_in_band - _start) / 1000);
+    r.overshoot = _overshoot;
+    r.ripple = _tmax - _tmin;
+    r.energy = _e_settle - _e_start;
+    _running = false;
+    return true;
+  }
+};
+
+} // namespace thermalsim
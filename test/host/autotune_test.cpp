@@ -0,0 +1,114 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  relay autotune against thermalsim::TipPlant, tuned gains must hold the plant at setpoint with pid::Controller
+*/
+#include "check.hpp"
+#include "autotune.hpp"
+#include "pid.hpp"
+#include "thermalsim.hpp"
+
+using autotune::RelayTuner;
+using thermalsim::TipPlant;
+
+namespace {
+
+// control loop period, ms
+constexpr uint32_t period_ms = 50;
+// relay output, 60% of full power as with default power budget
+constexpr uint32_t out_high = 154;
+
+/**
+ * @brief run relay test on a plant from ambient temperature
+ * @return test duration, ms
+ */
+uint32_t tune(TipPlant& plant, RelayTuner& tuner, const RelayTuner::Params& p){
+  plant.reset(0);
+  tuner.start(p, 0);
+  uint32_t now = 0;
+  while (tuner.running()){
+    plant.setDuty(tuner.step(now, plant.heaterTemp()));
+    now += period_ms;
+    plant.advance(static_cast<int64_t>(now) * 1000);
+  }
+  return now;
+}
+
+RelayTuner::Params params(float sp){
+  RelayTuner::Params p{};
+  p.setpoint = sp;
+  p.out_high = out_high;
+  p.t_max = sp + 50;
+  return p;
+}
+
+} // namespace
+
+int main(){
+  TipPlant plant;
+  RelayTuner tuner;
+
+  // relay test converges and reports ultimate gain and period
+  uint32_t duration = tune(plant, tuner, params(300));
+  CHECK(tuner.state() == RelayTuner::state_t::done);
+  CHECK(duration < 60000);
+  CHECK(tuner.ultimateGain() > 0);
+  CHECK(tuner.ultimatePeriod() > 0.1f && tuner.ultimatePeriod() < 10);
+  std::printf("autotune at 300C: %u ms, Ku:%.2f, Pu:%.2f s\n", duration, tuner.ultimateGain(), tuner.ultimatePeriod());
+
+  // tuned gains hold plant at setpoint, temperature is taken over from relay test without a reset
+  autotune::Gains g = tuner.gains();
+  CHECK(g.kp > 0 && g.ki > 0 && g.kd > 0);
+  pid::Controller<float> pid(pid::Gains<float>{g.kp, g.ki, g.kd});
+  pid.setOutputRange(0, out_high);
+  float tmin{1000}, tmax{0}, overshoot{0};
+  uint32_t now = duration;
+  for (uint32_t t = 0; t != 60000; t += period_ms){
+    float y = plant.heaterTemp();
+    plant.setDuty(static_cast<uint32_t>(pid.step(300, y, period_ms / 1000.0f)));
+    now += period_ms;
+    plant.advance(static_cast<int64_t>(now) * 1000);
+    if (y - 300 > overshoot) overshoot = y - 300;
+    // last 20 s
+    if (t >= 40000){
+      if (y < tmin) tmin = y;
+      if (y > tmax) tmax = y;
+    }
+  }
+  std::printf("tuned PID at 300C: overshoot %.1f C, steady %.1f..%.1f C\n", overshoot, tmin, tmax);
+  CHECK(tmin > 298 && tmax < 302);
+  CHECK(overshoot < 10);
+
+  // test fails if temperature runs away
+  RelayTuner::Params p = params(300);
+  p.t_max = 290;
+  tune(plant, tuner, p);
+  CHECK(tuner.state() == RelayTuner::state_t::failed);
+
+  // test fails on timeout, i.e. output is too low to reach setpoint
+  p = params(300);
+  p.out_high = 20;
+  p.timeout_ms = 30000;
+  duration = tune(plant, tuner, p);
+  CHECK(tuner.state() == RelayTuner::state_t::failed);
+  CHECK(duration <= p.timeout_ms + 2 * period_ms);
+
+  // aborted test gives low output
+  plant.reset(0);
+  tuner.start(params(300), 0);
+  tuner.abort();
+  CHECK(tuner.state() == RelayTuner::state_t::failed);
+  CHECK(tuner.step(period_ms, 25) == 0);
+
+  std::printf("autotune: %s\n", hosttest::failures ? "FAILED" : "ok");
+  return CHECK_RESULT();
+}
@@ -0,0 +1,27 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  Minimal check helpers for host unit tests, failed checks are printed and counted, test's exit code is non-zero if any failed
+*/
+#pragma once
+#include <cstdio>
+
+namespace hosttest {
+inline int failures{0};
+} // namespace hosttest
+
+#define CHECK(cond) do { if (!(cond)){ std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++hosttest::failures; } } while (0)
+#define CHECK_NEAR(a, b, eps) do { double _d = static_cast<double>(a) - static_cast<double>(b); if (_d > (eps) || _d < -(eps)){ \
+  std::printf("%s:%d: check failed: %s ~ %s, %g vs %g\n", __FILE__, __LINE__, #a, #b, static_cast<double>(a), static_cast<double>(b)); ++hosttest::failures; } } while (0)
+
+// test's exit code
+#define CHECK_RESULT() (hosttest::failures ? 1 : 0)
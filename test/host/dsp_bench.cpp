@@ -0,0 +1,81 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  ADC block filter benchmark, trimmed mean with sorting network / nth_element vs nested loop swap sort it replaced
+  prints best time per call over a number of batches, trim width is N/4 as in heater's _denoiseADC()
+*/
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include "dsp.hpp"
+
+namespace {
+
+constexpr int batches = 50;
+constexpr int calls = 2000;
+
+// heater's filter before dsp.hpp
+template <size_t N>
+uint32_t swapsort_mean(std::array<uint32_t, N>& samples){
+  for (size_t i = 0; i < samples.size(); ++i){
+    for (size_t j = i + 1; j < samples.size(); ++j){
+      if (samples[i] > samples[j]) {
+        std::swap(samples[i], samples[j]);
+      }
+    }
+  }
+  uint32_t result{0};
+  for (size_t i = samples.size() / 4; i < samples.size() * 3 / 4; i++) {
+    result += samples[i];
+  }
+  return result / (samples.size() / 2);
+}
+
+template <size_t N, typename F>
+double best_ns(F&& filter){
+  std::mt19937 rnd(N);
+  std::array<std::array<uint32_t, N>, 16> blocks;
+  for (auto &b : blocks)
+    for (auto &v : b) v = 500 + rnd() % 64;
+
+  volatile uint32_t sink{0};
+  double best{1e12};
+  for (int k = 0; k != batches; ++k){
+    auto t = std::chrono::steady_clock::now();
+    for (int c = 0; c != calls; ++c){
+      auto b = blocks[c % blocks.size()];
+      sink = sink + filter(b);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t).count() / calls;
+    if (ns < best) best = ns;
+  }
+  return best;
+}
+
+template <size_t N>
+void bench(){
+  double sw = best_ns<N>(swapsort_mean<N>);
+  double tm = best_ns<N>([](std::array<uint32_t, N>& b){ return dsp::trimmed_mean<N / 4>(b); });
+  std::printf("%5zu %14.1f %14.1f %8.1fx\n", N, sw, tm, sw / tm);
+}
+
+} // namespace
+
+int main(){
+  std::printf("%5s %14s %14s %9s\n", "N", "swap sort, ns", "trim mean, ns", "speedup");
+  bench<8>();
+  bench<16>();
+  bench<32>();
+  bench<64>();
+  bench<128>();
+  return 0;
+}
@@ -0,0 +1,135 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  dsp.hpp kernels against std::sort reference, sorting network is checked exhaustively on 0/1 inputs,
+  recovery tracker against exponential tails
+*/
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "check.hpp"
+#include "dsp.hpp"
+
+namespace {
+
+std::mt19937 rnd(12345);
+
+// 0-1 principle: a network sorts any input if it sorts all 2^N binary inputs
+template <size_t N>
+void sortnet_binary(){
+  for (uint32_t m = 0; m != (1u << N); ++m){
+    std::array<uint8_t, N> a;
+    for (size_t i = 0; i != N; ++i) a[i] = (m >> i) & 1;
+    dsp::SortNet<N>::sort(a);
+    CHECK(std::is_sorted(a.begin(), a.end()));
+  }
+}
+
+template <size_t N>
+void sortnet_random(){
+  for (int k = 0; k != 100; ++k){
+    std::array<uint32_t, N> a;
+    for (auto &v : a) v = rnd() % 3100;
+    auto ref = a;
+    std::sort(ref.begin(), ref.end());
+    dsp::SortNet<N>::sort(a);
+    CHECK(a == ref);
+  }
+}
+
+template <size_t N, size_t Trim>
+void trimmed_mean_random(){
+  for (int k = 0; k != 100; ++k){
+    std::array<uint32_t, N> a;
+    for (auto &v : a) v = rnd() % 3100;
+    auto ref = a;
+    std::sort(ref.begin(), ref.end());
+    uint64_t sum{0};
+    for (size_t i = Trim; i != N - Trim; ++i) sum += ref[i];
+    CHECK(dsp::trimmed_mean<Trim>(a) == sum / (N - 2 * Trim));
+  }
+}
+
+/**
+ * @brief feed an exponential tail from 'from' towards 'to' until tracker reports a settled value
+ * @return number of blocks fed, 0 if it has not settled within 'max' blocks
+ */
+uint32_t recovery_run(dsp::Recovery& rc, float from, float to, float r, int32_t& settled, uint32_t max = 40){
+  rc.start();
+  for (uint32_t k = 0; k != max; ++k){
+    int32_t v = static_cast<int32_t>(std::lround(to + (from - to) * std::pow(r, k)));
+    if (rc.feed(v, settled)) return k + 1;
+  }
+  return 0;
+}
+
+template <size_t... N>
+void sortnet_binary_all(std::index_sequence<N...>){ (sortnet_binary<N + 1>(), ...); }
+
+} // namespace
+
+int main(){
+  // networks are exhaustively checked up to 16 inputs, larger ones with random data
+  sortnet_binary_all(std::make_index_sequence<16>{});
+  sortnet_random<17>();
+  sortnet_random<24>();
+  sortnet_random<32>();
+
+  trimmed_mean_random<8, 2>();
+  trimmed_mean_random<32, 8>();
+  // nth_element path
+  trimmed_mean_random<64, 16>();
+  trimmed_mean_random<128, 32>();
+  trimmed_mean_random<64, 0>();
+
+  // outliers are dropped
+  std::array<int32_t, 8> spikes{100, 101, 3100, 99, 0, 100, 102, 98};
+  CHECK(dsp::trimmed_mean<2>(spikes) == 100);
+
+  std::array<float, 5> odd{5.0f, 1.0f, 4.0f, 2.0f, 3.0f};
+  CHECK(dsp::median(odd) == 3.0f);
+  std::array<int32_t, 4> even{4, 1, 3, 2};
+  CHECK(dsp::median(even) == 2);
+  // signed accumulator
+  std::array<int32_t, 4> neg{-4, -1, -3, -2};
+  CHECK(dsp::trimmed_mean<1>(neg) == -2);
+
+  // recovery: until ratio is learned, it waits for steps to fall within tolerance
+  dsp::Recovery plain(2, 1 << 30, 40);
+  int32_t settled{0};
+  uint32_t slow = recovery_run(plain, 3100, 600, 0.67f, settled);
+  CHECK(slow != 0 && plain.ratio() == 0);
+  CHECK(std::abs(settled - 600) <= 2 * 2);
+  // learned ratio gives a corrected reading earlier in the tail
+  dsp::Recovery rc(2, 20, 40);
+  for (int i = 0; i != 8; ++i) recovery_run(rc, 3100, 600, 0.67f, settled);
+  CHECK_NEAR(rc.ratio(), 0.67, 0.01);
+  uint32_t fast = recovery_run(rc, 3100, 500, 0.67f, settled);
+  CHECK(fast != 0 && fast < slow);
+  CHECK(std::abs(settled - 500) <= 2);
+  // flat signal settles on the second block as is
+  rc.start();
+  CHECK(!rc.feed(700, settled));
+  CHECK(rc.feed(701, settled) && settled == 701);
+  // a tail that does not follow learned ratio is not extrapolated, i.e. linear drift
+  rc.start();
+  bool early{false};
+  for (int32_t v = 800; v > 700; v -= 10)
+    early |= rc.feed(v, settled);
+  CHECK(!early);
+  // forgotten ratio
+  rc.reset();
+  CHECK(rc.ratio() == 0);
+
+  std::printf("dsp: %s\n", hosttest::failures ? "FAILED" : "ok");
+  return CHECK_RESULT();
+}
@@ -0,0 +1,135 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  Heater command latency benchmark
+  heater gets a stream of target temperature commands while UI lane is loaded with slow menu handlers and tip profiles
+  are selected, calibrated and matched, those go to NVS. Latency is post to dispatch time of heater commands, same as
+  'wait' in event loop statistics. Built with EVT_SINGLE_LOOP as 'evtlatency_single' for comparison.
+  Pass '-v' to see firmware log and event loop statistics.
+  Exit code is non-zero if command latency goes out of bounds in two lane build, so it doubles as a regression test
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include "hostsim.hpp"
+#include "const.h"
+#include "esp_rom_sys.h"
+#include "evtloop.hpp"
+#include "evtreg.hpp"
+#include "heater.hpp"
+#include "nvs_handle.hpp"
+
+namespace {
+
+constexpr int64_t ms = 1000, sec = 1000000;
+// modeled flash access, a blob read and a write with an occasional page erase, us
+constexpr uint32_t nvs_read = 400, nvs_write = 8000;
+// menu redraw handler run time, us
+constexpr uint32_t menu_run = 3000;
+// raw VISET event id for menu redraws
+constexpr int32_t evt_menu = 1000;
+
+// post times of commands awaiting dispatch
+std::deque<int64_t> posted;
+int64_t wait_max{0}, wait_sum{0};
+uint32_t cmds{0};
+
+void on_target(void*, esp_event_base_t, int32_t, void*){
+  if (posted.empty()) return;
+  int64_t w = hostsim::now() - posted.front();
+  posted.pop_front();
+  wait_max = std::max(wait_max, w);
+  wait_sum += w;
+  ++cmds;
+}
+
+void on_menu(void*, esp_event_base_t, int32_t, void*){ esp_rom_delay_us(menu_run); }
+
+} // namespace
+
+int main(int argc, char* argv[]){
+  hostsim::verbose = argc > 1 && !std::strcmp(argv[1], "-v");
+  hostsim::reset();
+  hostsim::nvs_read_us = nvs_read;
+  hostsim::nvs_write_us = nvs_write;
+  hostsim::analog_mv = [](uint8_t pin){ return pin == VIN_PIN ? static_cast<uint32_t>(hal::sim.plant().params().vin * 1000 / VIN_DIVIDER) : 0; };
+  evt::latest::vin.publish(20000);
+
+  evt::start();
+  TipHeater heater(5, HEATER_CHANNEL, HEATER_INVERT);
+  heater.init();
+  esp_event_handler_instance_t h_target, h_menu;
+  evt::subscribe(IRON_HEATER, e2int(evt::iron_t::heaterTargetT), on_target, nullptr, &h_target);
+  evt::subscribe(IRON_VISET, evt_menu, on_menu, nullptr, &h_menu);
+  hostsim::at(hostsim::now(), [](){ evt::post<evt::iron_t::heaterEnable>(IRON_HEATER); });
+  hostsim::run_for(sec);
+
+  int64_t t0 = hostsim::now(), end = t0 + 10 * sec;
+  // target temperature nudges, i.e. encoder turns
+  hostsim::every(t0, 10 * ms, [&](){
+    if (hostsim::now() >= end) return false;
+    posted.push_back(hostsim::now());
+    evt::post<evt::iron_t::heaterTargetT>(IRON_HEATER, int32_t(300 + (hostsim::now() / (10 * ms)) % 2));
+    return true;
+  });
+  // menu redraws
+  hostsim::every(t0 + 3 * ms, 20 * ms, [&](){
+    evt::post(IRON_VISET, evt_menu);
+    return hostsim::now() < end;
+  });
+  // tip profiles traffic, every command ends in NVS reads and writes
+  uint32_t tip{0};
+  hostsim::every(t0 + 5 * ms, 500 * ms, [&](){
+    evt::post<evt::iron_t::heaterTipSelect>(IRON_HEATER, ++tip % 2);
+    return hostsim::now() < end;
+  });
+  hostsim::every(t0 + 255 * ms, sec, [&](){
+    evt::post<evt::iron_t::heaterTipCalibrate>(IRON_HEATER, default_calibration);
+    evt::post<evt::iron_t::tipResistance>(evt::post_policy_t::deliver, IRON_NOTIFY, uint32_t(2000 + tip % 2 * 500));
+    return hostsim::now() < end;
+  });
+  hostsim::run_until(end + sec);
+
+  if (hostsim::verbose) evt::stats_print();
+#ifdef EVT_SINGLE_LOOP
+  const char* lanes = "single loop";
+#else
+  const char* lanes = "control/UI lanes";
+#endif
+  std::printf("%-18s %9s %9s %9s\n", "loops", "commands", "max us", "avg us");
+  std::printf("%-18s %9u %9lld %9lld\n", lanes, cmds, static_cast<long long>(wait_max), static_cast<long long>(cmds ? wait_sum / cmds : 0));
+
+  int failures{0};
+  if (cmds != 1000){
+    std::printf("FAIL: commands must not be dropped\n");
+    ++failures;
+  }
+  // tip commands are handed over to UI lane, the last selected tip must be stored
+  uint32_t stored{UINT32_MAX};
+  if (auto h = nvs::open_nvs_handle(T_Tips, NVS_READONLY)) h->get_item(T_tip, stored);
+  if (stored != tip % 2){
+    std::printf("FAIL: tip select must not be dropped, stored tip:%u, selected:%u\n", stored, tip % 2);
+    ++failures;
+  }
+#ifndef EVT_SINGLE_LOOP
+  // commands wait for other control lane events and heater task only, never for flash or UI handlers
+  if (wait_max >= nvs_read){
+    std::printf("FAIL: command latency must be below a single NVS read\n");
+    ++failures;
+  }
+#endif
+  evt::unsubscribe(IRON_HEATER, e2int(evt::iron_t::heaterTargetT), h_target);
+  evt::unsubscribe(IRON_VISET, evt_menu, h_menu);
+  evt::stop();
+  return failures ? 1 : 0;
+}
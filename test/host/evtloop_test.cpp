@@ -0,0 +1,102 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  event loop post policies on a full queue: coalescing into a post that is blocked and then dropped,
+  posts from timer service task, posts that never wait
+*/
+#include <stdexcept>
+#include <vector>
+#include "check.hpp"
+#include "hostsim.hpp"
+#include "esp_rom_sys.h"
+#include "evtloop.hpp"
+
+namespace {
+
+constexpr int64_t ms = 1000;
+// UI lane queue size, as ui_q_size in evtloop.cpp
+constexpr int ui_q_size = 16;
+// raw event ids on UI lane, out of iron_t range
+constexpr int32_t evt_fill = 1000, evt_value = 1001, evt_trigger = 1002, evt_stall = 1003;
+
+// payloads of evt_value in dispatch order
+std::vector<uint32_t> values;
+esp_err_t blocked_post{ESP_OK};
+
+void on_value(void*, esp_event_base_t, int32_t, void* data){ values.push_back(*static_cast<uint32_t*>(data)); }
+
+// fills it's own lane queue, then makes a bounded post that has to wait and time out
+void on_trigger(void*, esp_event_base_t, int32_t, void*){
+  for (int i = 0; i != ui_q_size; ++i)
+    evt::post(evt::post_policy_t::bounded, IRON_NOTIFY, evt_fill);
+  uint32_t v{1};
+  blocked_post = evt::post(evt::post_policy_t::bounded, IRON_NOTIFY, evt_value, &v, sizeof(v));
+}
+
+// fills it's own lane queue, then stays busy, i.e. writing flash
+void on_stall(void*, esp_event_base_t, int32_t, void*){
+  for (int i = 0; i != ui_q_size; ++i)
+    evt::post(evt::post_policy_t::bounded, IRON_NOTIFY, evt_fill);
+  esp_rom_delay_us(50 * ms);
+}
+
+} // namespace
+
+int main(){
+  hostsim::reset();
+  evt::start();
+  esp_event_handler_instance_t h_value, h_trigger, h_stall;
+  evt::subscribe(IRON_NOTIFY, evt_value, on_value, nullptr, &h_value);
+  evt::subscribe(IRON_NOTIFY, evt_trigger, on_trigger, nullptr, &h_trigger);
+  evt::subscribe(IRON_NOTIFY, evt_stall, on_stall, nullptr, &h_stall);
+
+  // a coalescing post lands while the only instance of the event is a post blocked on a full queue,
+  // that post times out, merged payload must be dropped with it and must not leak into a later event
+  hostsim::at(0, [](){ evt::post(evt::post_policy_t::bounded, IRON_NOTIFY, evt_trigger); });
+  hostsim::at(2 * ms, [](){ uint32_t v{2}; evt::post(evt::post_policy_t::coalesce, IRON_NOTIFY, evt_value, &v, sizeof(v)); });
+  hostsim::at(100 * ms, [](){ uint32_t v{3}; evt::post(evt::post_policy_t::coalesce, IRON_NOTIFY, evt_value, &v, sizeof(v)); });
+  hostsim::run_until(200 * ms);
+  CHECK(blocked_post == ESP_ERR_TIMEOUT);
+  CHECK(values.size() == 1);
+  CHECK(!values.empty() && values.back() == 3);
+
+  // timer service task must not wait for a full queue forever, even with deliver policy
+  esp_err_t err{ESP_OK};
+  bool blocked_forever{false};
+  hostsim::at(300 * ms, [](){ evt::post(evt::post_policy_t::bounded, IRON_NOTIFY, evt_stall); });
+  hostsim::timer_cb_at(301 * ms, [&](){
+    try {
+      err = evt::post(evt::post_policy_t::deliver, IRON_NOTIFY, evt_fill);
+    } catch (const std::logic_error&){
+      blocked_forever = true;
+    }
+  });
+  hostsim::run_until(500 * ms);
+  CHECK(!blocked_forever);
+  CHECK(err == ESP_ERR_TIMEOUT);
+
+  // nowait post to a full queue fails right away, even from a task that could wait
+  int64_t t_post{0}, t_done{0};
+  hostsim::at(600 * ms, [](){ evt::post(evt::post_policy_t::bounded, IRON_NOTIFY, evt_stall); });
+  hostsim::at(601 * ms, [&](){
+    t_post = hostsim::now();
+    err = evt::post(evt::post_policy_t::nowait, IRON_NOTIFY, evt_fill);
+    t_done = hostsim::now();
+  });
+  hostsim::run_until(800 * ms);
+  CHECK(err == ESP_ERR_TIMEOUT);
+  CHECK(t_done == t_post);
+
+  evt::stop();
+  std::printf("evtloop: %s\n", hosttest::failures ? "FAILED" : "ok");
+  return CHECK_RESULT();
+}
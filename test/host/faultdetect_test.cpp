@@ -0,0 +1,102 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  heater fault detector on synthetic readings, readings carry ADC noise of +-1 LSB as trimmed mean of a sample block does
+*/
+#include <functional>
+#include <random>
+#include "check.hpp"
+#include "faultdetect.hpp"
+
+using faults::FaultDetector;
+using faults::fault_t;
+
+namespace {
+
+// control loop period, ms
+constexpr uint32_t period_ms = 100;
+// ADC LSB, C per mV
+constexpr float lsb = 0.5378f;
+
+std::mt19937 rnd(7);
+
+// a reading with +-1 LSB of noise quantized to ADC steps
+float noisy(float t){
+  int32_t mv = static_cast<int32_t>(t / lsb + 0.5f) + static_cast<int32_t>(rnd() % 3) - 1;
+  return mv * lsb;
+}
+
+/**
+ * @brief feed detector for a duration
+ * @param t temperature at time, ms
+ * @param u output at time, ms
+ * @return fault_t fault detected
+ */
+fault_t run(FaultDetector& fd, uint32_t duration, std::function<float(uint32_t)> t, std::function<float(uint32_t)> u){
+  fd.reset();
+  fault_t f{fault_t::none};
+  for (uint32_t now = 0; now < duration && f == fault_t::none; now += period_ms)
+    f = fd.step(now, t(now), u(now));
+  return f;
+}
+
+} // namespace
+
+int main(){
+  FaultDetector fd;
+  constexpr uint32_t test_ms = 30000;
+
+  // live tip held at setpoint at partial power does not trip, whatever small it's span is
+  CHECK(run(fd, test_ms, [](uint32_t){ return noisy(300); }, [](uint32_t){ return 0.3f; }) == fault_t::none);
+  CHECK(run(fd, test_ms, [](uint32_t){ return 300.0f; }, [](uint32_t){ return 0.3f; }) == fault_t::none);
+  // idle tip at ambient
+  CHECK(run(fd, test_ms, [](uint32_t){ return noisy(25); }, [](uint32_t){ return 0.0f; }) == fault_t::none);
+  // heat-up at full available power, 20 C/s
+  CHECK(run(fd, 20000, [](uint32_t ms){ return noisy(25 + ms * 0.02f); }, [](uint32_t){ return 1.0f; }) == fault_t::none);
+  // heat-up on a weak supply, 3 C/s
+  CHECK(run(fd, test_ms, [](uint32_t ms){ return noisy(25 + ms * 0.003f); }, [](uint32_t){ return 1.0f; }) == fault_t::none);
+  // natural cool-down with heater off
+  CHECK(run(fd, test_ms, [](uint32_t ms){ return noisy(300 - ms * 0.002f); }, [](uint32_t){ return 0.0f; }) == fault_t::none);
+
+  // frozen OpAmp output read with ADC noise while controller pushes full power
+  CHECK(run(fd, test_ms, [](uint32_t){ return noisy(250); }, [](uint32_t){ return 1.0f; }) == fault_t::sensor_stuck);
+  CHECK(run(fd, test_ms, [](uint32_t){ return 250.0f; }, [](uint32_t){ return 1.0f; }) == fault_t::sensor_stuck);
+
+  // open heater, cold tip reading with noise at full power
+  CHECK(run(fd, test_ms, [](uint32_t){ return noisy(25); }, [](uint32_t){ return 1.0f; }) == fault_t::open_heater);
+  // output is relative to available max, i.e. duty capped at budget still counts as full power
+  CHECK(run(fd, test_ms, [](uint32_t){ return noisy(25); }, [](uint32_t){ return 0.95f; }) == fault_t::open_heater);
+
+  // temperature keeps rising with heater off
+  CHECK(run(fd, test_ms, [](uint32_t ms){ return noisy(100 + ms * 0.01f); }, [](uint32_t){ return 0.0f; }) == fault_t::stuck_on);
+
+  // over-temperature must persist
+  CHECK(run(fd, test_ms, [](uint32_t ms){ return ms % 2000 < 500 ? 490.0f : 300.0f; }, [](uint32_t){ return 0.3f; }) == fault_t::none);
+  CHECK(run(fd, test_ms, [](uint32_t ms){ return ms > 5000 ? 490.0f : 300.0f; }, [](uint32_t){ return 0.3f; }) == fault_t::overtemp);
+
+  // runaway at 40 C/s passes t_max and open sensor level within overtemp time
+  CHECK(run(fd, test_ms, [](uint32_t ms){ return noisy(300 + ms * 0.04f); }, [](uint32_t){ return 0.0f; }) == fault_t::overtemp);
+  // removed tip jumps to open sensor level from working temperature, it is not a fault
+  CHECK(run(fd, test_ms, [](uint32_t ms){ return ms > 5000 ? noisy(650) : noisy(300); }, [](uint32_t){ return 0.3f; }) == fault_t::none);
+  CHECK(run(fd, test_ms, [](uint32_t ms){ return ms > 5000 ? noisy(650) : noisy(300); }, [](uint32_t ms){ return ms > 5000 ? 1.0f : 0.3f; }) == fault_t::none);
+
+  // fault is latched until reset
+  fd.reset();
+  for (uint32_t now = 0; now <= 6000; now += period_ms) fd.step(now, 25, 1.0f);
+  CHECK(fd.fault() == fault_t::open_heater);
+  CHECK(fd.step(6100, 300, 0.3f) == fault_t::open_heater);
+  fd.reset();
+  CHECK(fd.step(6200, 300, 0.3f) == fault_t::none);
+
+  std::printf("faultdetect: %s\n", hosttest::failures ? "FAILED" : "ok");
+  return CHECK_RESULT();
+}
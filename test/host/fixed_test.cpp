@@ -0,0 +1,80 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  Fixed<> arithmetic against float, temperature conversion and smoothing the way heater does it in Q16.16
+*/
+#include <cmath>
+#include <random>
+#include "check.hpp"
+#include "config.h"
+#include "fixed.hpp"
+
+namespace {
+
+// same as in heater.cpp
+constexpr float mv2c_k = 0.5378f, mv2c_b = 6.3959f;
+
+template <typename T>
+T mv2celsius(uint32_t mv){
+  T t = T(mv2c_k) * T(mv) + T(mv2c_b);
+  return t < T(20) ? T(20) : (t > T(1000) ? T(1000) : t);
+}
+
+template <typename T>
+T smooth(T avg, T t){ return avg + (t - avg) * T(SMOOTHIE); }
+
+} // namespace
+
+int main(){
+  // construction and conversion
+  CHECK(static_cast<int32_t>(q16_t(300)) == 300);
+  CHECK(q16_t(1).raw() == 1 << 16);
+  CHECK(q16_t(0.5f).raw() == 1 << 15);
+  CHECK(q16_t(-0.5f).raw() == -(1 << 15));
+  CHECK(q16_t::fromRaw(3).raw() == 3);
+  CHECK_NEAR(static_cast<float>(q16_t(-2.25)), -2.25, 0);
+
+  // arithmetic is exact on representable values and truncates otherwise
+  CHECK(q16_t(3) * q16_t(4) == q16_t(12));
+  CHECK(q16_t(12) / q16_t(4) == q16_t(3));
+  CHECK(q16_t(7) - q16_t(10) == q16_t(-3));
+  CHECK(-q16_t(5) == q16_t(-5));
+  CHECK(q16_t(1) / q16_t(3) == q16_t::fromRaw(21845));
+  CHECK(q16_t(2) < q16_t(3) && q16_t(3) >= q16_t(3) && q16_t(-1) < q16_t(0));
+
+  // products of temperature range values do not overflow 64 bit intermediates
+  std::mt19937 rnd(42);
+  for (int i = 0; i != 10000; ++i){
+    float a = static_cast<float>(rnd() % 200000) / 100.0f - 1000.0f;
+    float b = static_cast<float>(rnd() % 2000) / 1000.0f;
+    CHECK_NEAR(static_cast<float>(q16_t(a) * q16_t(b)), a * b, 0.05);
+    // quotient must fit Q16.16 range, it's error is dominated by divisor's quantization
+    if (b > 0.05f) CHECK_NEAR(static_cast<float>(q16_t(a) / q16_t(b)), a / b, 0.05 + std::fabs(a / b) / (b * q16_t::one));
+  }
+
+  // heater's conversion over whole OpAmp output range
+  for (uint32_t mv = 0; mv <= 3300; ++mv)
+    CHECK_NEAR(static_cast<float>(mv2celsius<q16_t>(mv)), mv2celsius<float>(mv), 0.05);
+
+  // smoothing of a noisy reading stays close to float, truncation errors do not accumulate
+  q16_t avg(20);
+  float favg{20};
+  for (int i = 0; i != 10000; ++i){
+    uint32_t mv = 550 + rnd() % 11;
+    avg = smooth(avg, mv2celsius<q16_t>(mv));
+    favg = smooth(favg, mv2celsius<float>(mv));
+    CHECK_NEAR(static_cast<float>(avg), favg, 0.05);
+  }
+
+  std::printf("fixed: %s\n", hosttest::failures ? "FAILED" : "ok");
+  return CHECK_RESULT();
+}
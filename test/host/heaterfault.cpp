@@ -0,0 +1,105 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  Heater tip removal and thermal runaway against simulated plant
+  a removed tip reads beyond no-tip level and must not latch a fault, a shorted MOSFET drives temperature
+  past the same level and must be reported as over-temperature, not as a tip ejection.
+  Pass '-v' to see firmware log
+*/
+#include <cstdio>
+#include <cstring>
+#include "check.hpp"
+#include "hostsim.hpp"
+#include "const.h"
+#include "evtloop.hpp"
+#include "evtreg.hpp"
+#include "heater.hpp"
+
+namespace {
+
+constexpr int64_t sec = 1000000;
+
+faults::fault_t fault{faults::fault_t::none};
+uint32_t ejects{0}, inserts{0};
+
+void on_fault(void*, esp_event_base_t, int32_t, void* data){ fault = *static_cast<faults::fault_t*>(data); }
+void on_eject(void*, esp_event_base_t, int32_t, void*){ ++ejects; }
+void on_insert(void*, esp_event_base_t, int32_t, void*){ ++inserts; }
+
+} // namespace
+
+int main(int argc, char* argv[]){
+  hostsim::verbose = argc > 1 && !std::strcmp(argv[1], "-v");
+  hostsim::reset();
+  hostsim::analog_mv = [](uint8_t pin){ return pin == VIN_PIN ? static_cast<uint32_t>(hal::sim.plant().params().vin * 1000 / VIN_DIVIDER) : 0; };
+  evt::latest::vin.publish(20000);
+
+  evt::start();
+  esp_event_handler_instance_t h_fault{nullptr}, h_eject{nullptr}, h_insert{nullptr};
+  evt::subscribe(IRON_NOTIFY, e2int(evt::iron_t::heaterFault), on_fault, nullptr, &h_fault);
+  evt::subscribe(SENSOR_DATA, e2int(evt::iron_t::tipEject), on_eject, nullptr, &h_eject);
+  evt::subscribe(SENSOR_DATA, e2int(evt::iron_t::tipInsert), on_insert, nullptr, &h_insert);
+
+  TipHeater heater(5, HEATER_CHANNEL, HEATER_INVERT);
+  heater.init();
+  hostsim::run_for(sec);
+
+  hostsim::at(hostsim::now(), [](){
+    evt::post<evt::iron_t::heaterTargetT>(IRON_HEATER, int32_t(250));
+    evt::post<evt::iron_t::heaterEnable>(IRON_HEATER);
+  });
+  hostsim::run_for(25 * sec);
+  CHECK(std::abs(heater.getCurrentTemp() - 250) < 5);
+
+  // removed tip reads beyond no-tip level for longer than over-temperature time
+  hostsim::at(hostsim::now(), [](){ hal::sim.plant().setTip(false); });
+  hostsim::run_for(5 * sec);
+  CHECK(ejects == 1);
+  CHECK(fault == faults::fault_t::none);
+  CHECK(hal::sim.plant().getDuty() == 0);
+
+  hostsim::at(hostsim::now(), [](){ hal::sim.plant().setTip(true); });
+  hostsim::run_for(10 * sec);
+  CHECK(inserts == 1);
+  CHECK(fault == faults::fault_t::none);
+
+  // at max target temperature
+  hostsim::at(hostsim::now(), [](){ evt::post<evt::iron_t::heaterTargetT>(IRON_HEATER, int32_t(TEMP_MAX)); });
+  hostsim::run_for(30 * sec);
+  CHECK(std::abs(heater.getCurrentTemp() - TEMP_MAX) < 5);
+  CHECK(fault == faults::fault_t::none);
+
+  // fully shorted MOSFET, temperature passes fault threshold and no-tip level in well under a second,
+  // too soon for a stuck MOSFET to be told by temperature rise over observation window
+  int64_t t_short = hostsim::now();
+  hostsim::at(t_short, [](){
+    hal::sim.plant().setLeak(1.0f);
+    hal::sim.plant().injectFault(thermalsim::fault_t::stuck_on);
+  });
+  float t_peak{0};
+  hostsim::every(t_short, 1000, [&](){
+    t_peak = std::max(t_peak, hal::sim.plant().heaterTemp());
+    return fault == faults::fault_t::none;
+  });
+  hostsim::run_for(30 * sec);
+  std::printf("runaway: fault:%u, tip ejects:%u, heater node at %.1f C on detection\n", e2int(fault), ejects, t_peak);
+  CHECK(fault == faults::fault_t::overtemp);
+  CHECK(ejects == 1);
+
+  evt::unsubscribe(IRON_NOTIFY, e2int(evt::iron_t::heaterFault), h_fault);
+  evt::unsubscribe(SENSOR_DATA, e2int(evt::iron_t::tipEject), h_eject);
+  evt::unsubscribe(SENSOR_DATA, e2int(evt::iron_t::tipInsert), h_insert);
+  evt::stop();
+
+  std::printf("heaterfault: %s\n", hosttest::failures ? "FAILED" : "ok");
+  return CHECK_RESULT();
+}
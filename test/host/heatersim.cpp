@@ -0,0 +1,213 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  Heater simulator and benchmark
+  firmware's TipHeater runs against hal::SimIron thermal plant on virtual time, commands come through the event loop
+  same as on the Iron. Scenarios are run back to back on one timeline, heat-up metrics are collected from temperature
+  as measured by the heater, sense bias is the difference to plant's heater node at the end of a scenario.
+  Pass '-v' to see firmware log.
+  Exit code is non-zero if a scenario goes out of bounds, so it doubles as a regression test
+*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "hostsim.hpp"
+#include "const.h"
+#include "evtloop.hpp"
+#include "evtreg.hpp"
+#include "heater.hpp"
+
+using thermalsim::HeatupMetrics;
+
+namespace {
+
+constexpr int64_t sec = 1000000;
+
+struct Result {
+  const char* name;
+  bool settled;
+  HeatupMetrics::Report r;
+  // max temperature deviation below target, C
+  float droop;
+  // mean error and peak-to-peak swing of measured temperature over scenario's tail, C
+  float error, swing;
+  // mean of measured minus plant's heater node temperature over scenario's tail, C
+  float bias;
+  // mean heater power over scenario's tail, % of full power at current supply voltage
+  float power;
+};
+
+// steady-state statistics are collected over the last seconds of a scenario
+constexpr int64_t tail = 5 * sec;
+
+int failures{0};
+TipHeater* iron{nullptr};
+// fault reported by heater, time it was reported
+faults::fault_t fault{faults::fault_t::none};
+int64_t fault_time{0};
+
+void on_fault(void*, esp_event_base_t, int32_t, void* data){
+  fault = *static_cast<faults::fault_t*>(data);
+  fault_time = hostsim::now();
+}
+
+void check(bool ok, const char* what){
+  if (ok) return;
+  std::printf("FAIL: %s\n", what);
+  ++failures;
+}
+
+/**
+ * @brief run a step to a new target and collect heat-up metrics
+ *
+ * @param setup action applied at step start, i.e. a command post or plant change
+ * @param duration time to run, s
+ */
+Result step(const char* name, int32_t target, int64_t duration, std::function<void()> setup){
+  // measured temperature is an integer with a few C of ADC noise, band is wider than for plant node
+  HeatupMetrics m(5.0f);
+  Result res{name, false, {}, 0, 0, 0, 0, 0};
+  float tmin{1000}, tmax{0}, sum{0}, bias{0}, e_tail{-1};
+  uint32_t n{0};
+  int64_t t0 = hostsim::now();
+  hostsim::at(t0, [&](){
+    setup();
+    auto &p = hal::sim.plant();
+    m.start(p.time(), target, p.energy());
+  });
+
+  int64_t end = t0 + duration * sec;
+  hostsim::every(t0, 1000, [&](){
+    if (hostsim::now() >= end) return false;
+    auto &p = hal::sim.plant();
+    float t = static_cast<float>(iron->getCurrentTemp());
+    if (target - t > res.droop && hostsim::now() - t0 > sec) res.droop = target - t;
+    if (m.running() && m.feed(p.time(), t, p.energy(), res.r)) res.settled = true;
+    if (hostsim::now() >= end - tail){
+      if (e_tail < 0) e_tail = p.energy();
+      tmin = std::min(tmin, t); tmax = std::max(tmax, t);
+      sum += t; bias += t - p.heaterTemp(); ++n;
+    }
+    return true;
+  });
+  hostsim::run_until(end);
+  if (n){
+    res.error = sum / n - target;
+    res.swing = tmax - tmin;
+    res.bias = bias / n;
+    const auto &pp = hal::sim.plant().params();
+    res.power = (hal::sim.plant().energy() - e_tail) / (pp.vin * pp.vin / pp.r_heater * tail / sec) * 100;
+  }
+  return res;
+}
+
+void print(const Result& r){
+  if (r.settled)
+    std::printf("%-28s %9u %9.1f %9.1f", r.name, r.r.settle_ms, r.r.overshoot, r.r.energy);
+  else
+    std::printf("%-28s %9s %9s %9s", r.name, "-", "-", "-");
+  std::printf(" %9.1f %9.1f %9.1f %9.1f %9.1f\n", r.droop, r.error, r.swing, r.bias, r.power);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]){
+  hostsim::verbose = argc > 1 && !std::strcmp(argv[1], "-v");
+  hostsim::reset();
+
+  // supply sense divider reads plant's Vin, PD trigger is at 20 V
+  hostsim::analog_mv = [](uint8_t pin){ return pin == VIN_PIN ? static_cast<uint32_t>(hal::sim.plant().params().vin * 1000 / VIN_DIVIDER) : 0; };
+  evt::latest::vin.publish(20000);
+
+  evt::start();
+  TipHeater heater(5, HEATER_CHANNEL, HEATER_INVERT);
+  heater.init();
+  iron = &heater;
+  // let heater settle in inactive state
+  hostsim::run_for(sec);
+
+  auto wall = std::chrono::steady_clock::now();
+  int64_t t_start = hostsim::now();
+
+  std::printf("%-28s %9s %9s %9s %9s %9s %9s %9s %9s\n", "scenario", "settle ms", "overshoot", "energy J", "droop C", "error C", "swing C", "bias C", "power %");
+
+  Result r = step("heat-up 25->320C, 20V", 320, 40, [](){
+    evt::post<evt::iron_t::heaterTargetT>(IRON_HEATER, int32_t(320));
+    evt::post<evt::iron_t::heaterEnable>(IRON_HEATER);
+  });
+  print(r);
+  check(r.settled && r.r.settle_ms < 20000, "heat-up must settle within 20 s");
+  check(r.r.overshoot < 10, "heat-up overshoot must be below 10 C");
+  check(std::fabs(r.error) < 3 && r.swing < 4, "temperature must hold within 3 C at 320C");
+  check(std::fabs(r.bias) < 3, "sense bias must be below 3 C at 320C");
+
+  r = step("setpoint 320->250C", 250, 40, [](){ evt::post<evt::iron_t::heaterTargetT>(IRON_HEATER, int32_t(250)); });
+  print(r);
+  check(r.settled, "setpoint step down must settle");
+  check(std::fabs(r.error) < 3 && r.swing < 4, "temperature must hold within 3 C at 250C");
+  check(std::fabs(r.bias) < 3, "sense bias must be below 3 C at 250C");
+
+  r = step("thermal load 0.15 W/K at 250C", 250, 30, [](){ hal::sim.plant().setLoad(0.15f); });
+  print(r);
+  check(r.settled, "temperature must recover under thermal load");
+  check(r.droop < 25, "thermal load droop must be below 25 C");
+  check(std::fabs(r.error) < 5, "temperature must hold within 5 C under thermal load");
+  check(std::fabs(r.bias) < 3, "sense bias must be below 3 C under thermal load");
+  hal::sim.plant().setLoad(0);
+
+  // heat drain beyond power budget, controller is saturated and measurement off-time takes from the power left
+  r = step("heavy load 0.25 W/K at 250C", 250, 10, [](){ hal::sim.plant().setLoad(0.25f); });
+  print(r);
+  // 3A budget caps duty at 60% on 20V supply
+  check(r.power > 50, "saturated heater must keep at least 50% of full power");
+  check(std::fabs(r.bias) < 3, "sense bias must be below 3 C with saturated heater");
+  hal::sim.plant().setLoad(0);
+  // let tip recover before next scenario
+  hostsim::run_for(20 * sec);
+
+  r = step("supply 20->12V at 250C", 250, 20, [](){
+    hal::sim.plant().setVin(12.0f);
+    evt::latest::vin.publish(12000);
+  });
+  print(r);
+  check(r.settled && std::fabs(r.error) < 3, "temperature must hold on supply voltage change");
+  check(std::fabs(r.bias) < 3, "sense bias must be below 3 C on 12V supply");
+
+  // faults are latched, so this goes last. OpAmp output freezes at 250C and reads with ADC noise only,
+  // controller pushes full power into a reading that does not move
+  esp_event_handler_instance_t fault_hndlr{nullptr};
+  evt::subscribe(IRON_NOTIFY, e2int(evt::iron_t::heaterFault), on_fault, nullptr, &fault_hndlr);
+  int64_t t_stuck = hostsim::now();
+  hostsim::at(t_stuck, [](){
+    hal::sim.plant().injectFault(thermalsim::fault_t::sensor_stuck);
+    // reading stays at 250C while temperature target is raised
+    evt::post<evt::iron_t::heaterTargetT>(IRON_HEATER, int32_t(300));
+  });
+  hostsim::run_for(20 * sec);
+  if (fault != faults::fault_t::none)
+    std::printf("%-28s fault:%u in %lld ms, plant at %.1f C\n", "sensor stuck at 250C", e2int(fault),
+      static_cast<long long>((fault_time - t_stuck) / 1000), hal::sim.plant().heaterTemp());
+  else
+    std::printf("%-28s not detected, plant at %.1f C\n", "sensor stuck at 250C", hal::sim.plant().heaterTemp());
+  check(fault == faults::fault_t::sensor_stuck, "stuck sensor must be detected");
+  check(hal::sim.plant().getDuty() == 0, "heater must be shut off on fault");
+  evt::unsubscribe(IRON_NOTIFY, e2int(evt::iron_t::heaterFault), fault_hndlr);
+
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+  double sim_s = static_cast<double>(hostsim::now() - t_start) / sec;
+  std::printf("simulated %.0f s in %.3f s, %.0fx real time\n", sim_s, wall_s, sim_s / wall_s);
+
+  evt::stop();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+/*
+  pid::Controller in float and Q16.16: saturation and anti-windup, bumpless transfer, derivative kick,
+  gain schedule and a step response against thermalsim::TipPlant
+*/
+#include "check.hpp"
+#include "fixed.hpp"
+#include "pid.hpp"
+#include "thermalsim.hpp"
+
+namespace {
+
+// gains as tuned by relay test against default plant, output is duty of 256
+constexpr pid::Gains<float> tuned{20.9f, 29.7f, 1.06f};
+// output cap, 60% of full power as with default power budget
+constexpr float out_max = 154;
+// control loop period, s
+constexpr float dt = 0.05f;
+
+template <typename T>
+pid::Gains<T> gains(const pid::Gains<float>& g){ return { T(g.kp), T(g.ki), T(g.kd) }; }
+
+template <typename T>
+float f(T v){ return static_cast<float>(v); }
+
+template <typename T>
+void saturation(float eps){
+  pid::Controller<T> c(gains<T>({2, 1, 0}));
+  c.setOutputRange(T(0), T(100));
+  // long saturation at max must not wind integrator beyond output range
+  for (int i = 0; i != 1000; ++i)
+    CHECK_NEAR(f(c.step(T(300), T(100), T(dt))), 100, eps);
+  CHECK(f(c.integral()) <= 100 + eps);
+  // once measurement crosses setpoint, output leaves saturation right away
+  CHECK(f(c.step(T(300), T(305), T(dt))) < 100);
+  // and at min
+  for (int i = 0; i != 1000; ++i) c.step(T(100), T(300), T(dt));
+  CHECK(f(c.integral()) >= -eps);
+  CHECK(f(c.step(T(100), T(95), T(dt))) > 0);
+}
+
+template <typename T>
+void bumpless(float eps){
+  pid::Controller<T> c(gains<T>(tuned));
+  c.setOutputRange(T(0), T(out_max));
+  // take over from an externally applied output, first step gives the same output
+  c.track(T(300), T(290), T(60));
+  CHECK_NEAR(f(c.step(T(300), T(290), T(dt))), 60, eps);
+
+  // preset holding power below setpoint, output is P term plus holding power, no derivative kick
+  c.reset();
+  c.preset(T(40), T(280));
+  CHECK_NEAR(f(c.step(T(300), T(280), T(dt))), out_max < 40 + tuned.kp * 20 ? out_max : 40 + tuned.kp * 20, eps);
+  c.reset();
+  c.preset(T(40), T(295));
+  CHECK_NEAR(f(c.step(T(300), T(295), T(dt))), 40 + tuned.kp * 5, eps);
+
+  // setpoint change does not kick derivative, output changes by P term only
+  c.reset();
+  c.track(T(300), T(300), T(40));
+  float u0 = f(c.step(T(300), T(300), T(dt)));
+  float u1 = f(c.step(T(302), T(300), T(dt)));
+  CHECK_NEAR(u1 - u0, tuned.kp * 2, eps);
+  // measurement change does, derivative opposes it
+  c.reset();
+  c.track(T(300), T(300), T(40));
+  c.step(T(300), T(300), T(dt));
+  float u2 = f(c.step(T(300), T(299), T(dt)));
+  CHECK(u2 > u0 + tuned.kp * 1);
+}
+
+struct Response {
+  float overshoot, settle_s, tmin, tmax;
+};
+
+// heat-up from ambient with PID engaged from the start
+template <typename T>
+Response step_response(float sp, float* trace){
+  thermalsim::TipPlant plant;
+  plant.reset(0);
+  pid::Controller<T> c(gains<T>(tuned));
+  c.setOutputRange(T(0), T(out_max));
+
+  thermalsim::HeatupMetrics m(1.0f, 5000);
+  m.start(0, sp, 0);
+  Response r{0, -1, 1000, 0};
+  thermalsim::HeatupMetrics::Report rep;
+  int64_t now = 0;
+  for (int i = 0; i != 1200; ++i){
+    float y = plant.heaterTemp();
+    if (trace) trace[i] = y;
+    if (y - sp > r.overshoot) r.overshoot = y - sp;
+    if (m.feed(now, y, plant.energy(), rep)) r.settle_s = rep.settle_ms / 1000.0f;
+    if (i >= 1000){
+      if (y < r.tmin) r.tmin = y;
+      if (y > r.tmax) r.tmax = y;
+    }
+    plant.setDuty(static_cast<uint32_t>(f(c.step(T(sp), T(y), T(dt)))));
+    now += static_cast<int64_t>(dt * 1e6f);
+    plant.advance(now);
+  }
+  return r;
+}
+
+} // namespace
+
+int main(){
+  saturation<float>(1e-3f);
+  saturation<q16_t>(0.01f);
+  bumpless<float>(1e-3f);
+  bumpless<q16_t>(0.05f);
+
+  // gain schedule interpolates between points and holds beyond them
+  pid::Schedule<float> s{};
+  s.set(300, {10, 1, 1}, 25);
+  s.set(200, {20, 2, 2}, 25);
+  CHECK_NEAR(s.at(250).kp, 15, 1e-4);
+  CHECK_NEAR(s.at(100).kp, 20, 0);
+  CHECK_NEAR(s.at(400).kp, 10, 0);
+  // a close point is replaced
+  s.set(310, {12, 1, 1}, 25);
+  CHECK(s.n == 2);
+  CHECK_NEAR(s.at(310).kp, 12, 0);
+
+  // step response, Q16.16 controller must follow float one
+  static float tf[1200], tq[1200];
+  Response rf = step_response<float>(300, tf);
+  Response rq = step_response<q16_t>(300, tq);
+  float dev{0};
+  for (int i = 0; i != 1200; ++i) if (std::fabs(tf[i] - tq[i]) > dev) dev = std::fabs(tf[i] - tq[i]);
+  std::printf("%-8s %10s %10s %14s\n", "PID", "overshoot", "settle s", "steady C");
+  std::printf("%-8s %10.2f %10.2f %6.2f..%6.2f\n", "float", rf.overshoot, rf.settle_s, rf.tmin, rf.tmax);
+  std::printf("%-8s %10.2f %10.2f %6.2f..%6.2f\n", "q16", rq.overshoot, rq.settle_s, rq.tmin, rq.tmax);
+  std::printf("max Q16.16 deviation from float: %.3f C\n", dev);
+  CHECK(rf.overshoot < 10 && rf.settle_s > 0 && rf.settle_s < 30);
+  CHECK(rf.tmin > 299 && rf.tmax < 301);
+  CHECK(rq.overshoot < 10 && rq.settle_s > 0 && rq.settle_s < 30);
+  CHECK(rq.tmin > 299 && rq.tmax < 301);
+  CHECK(dev < 0.5f);
+
+  std::printf("pid: %s\n", hosttest::failures ? "FAILED" : "ok");
+  return CHECK_RESULT();
+}
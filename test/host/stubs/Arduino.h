@@ -0,0 +1,27 @@
+// host stub of Arduino core API used by firmware sources
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// serial log, output is printed to stdout only when hostsim::verbose is set
+class HardwareSerial {
+public:
+  size_t print(const char* s);
+  size_t print(char c);
+  size_t println(const char* s = "");
+  size_t printf(const char* fmt, ...);
+};
+
+extern HardwareSerial Serial;
+
+void delayMicroseconds(uint32_t us);
+void delay(uint32_t ms);
+unsigned long millis();
+unsigned long micros();
+uint32_t analogReadMilliVolts(uint8_t pin);
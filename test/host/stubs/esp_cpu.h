@@ -0,0 +1,6 @@
+// host stub, cycle counter is taken from virtual time at 240 MHz
+#pragma once
+#include <stdint.h>
+#include "esp_timer.h"
+
+inline uint32_t esp_cpu_get_cycle_count(){ return static_cast<uint32_t>(esp_timer_get_time() * 240); }
@@ -0,0 +1,8 @@
+// host stub of IDF logging, errors and warnings go to stderr
+#pragma once
+#include <cstdio>
+
+#define ESP_LOGE(tag, fmt, ...) std::fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) std::fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) do { (void)(tag); } while(0)
+#define ESP_LOGD(tag, fmt, ...) do { (void)(tag); } while(0)
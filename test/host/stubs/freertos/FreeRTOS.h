@@ -0,0 +1,29 @@
+// host stub of FreeRTOS types, tasks run on hostsim virtual time
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdFALSE                   0
+#define pdTRUE                    1
+#define pdPASS                    pdTRUE
+#define pdFAIL                    pdFALSE
+#define portMAX_DELAY             (TickType_t)0xffffffffUL
+#define configTICK_RATE_HZ        1000
+#define portTICK_PERIOD_MS        (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)         ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define tskIDLE_PRIORITY          0
+#define tskNO_AFFINITY            0x7fffffff
+#define IRAM_ATTR
+
+// single-threaded scheduler, critical sections are no-op
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(m)     (void)(m)
+#define portEXIT_CRITICAL(m)      (void)(m)
+#define portENTER_CRITICAL_ISR(m) (void)(m)
+#define portEXIT_CRITICAL_ISR(m)  (void)(m)
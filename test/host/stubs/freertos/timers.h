@@ -0,0 +1,5 @@
+// host stub of FreeRTOS software timers, only the timer service task handle is provided
+#pragma once
+#include "freertos/task.h"
+
+TaskHandle_t xTimerGetTimerDaemonTaskHandle();
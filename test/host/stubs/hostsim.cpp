@@ -0,0 +1,463 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#include <cstdarg>
+#include <deque>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "esp_event.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/timers.h"
+#include "nvs_handle.hpp"
+#include "hostsim.hpp"
+
+struct hostsim_task {
+  const char* name;
+  UBaseType_t prio;
+  TaskFunction_t fn{nullptr};
+  void* arg{nullptr};
+  uint32_t notify{0};
+  bool alive{true};
+};
+
+struct esp_timer {
+  esp_timer_cb_t cb;
+  void* arg;
+  int64_t expiry{0};
+  bool armed{false};
+};
+
+namespace hostsim {
+
+std::function<uint32_t(uint8_t pin)> analog_mv;
+uint32_t nvs_read_us{0}, nvs_write_us{0};
+bool verbose{false};
+
+namespace {
+
+struct Handler {
+  esp_event_base_t base;
+  int32_t id;
+  esp_event_handler_t fn;
+  void* arg;
+  bool removed{false};
+};
+
+struct Event {
+  esp_event_base_t base;
+  int32_t id;
+  std::vector<uint8_t> data;
+};
+
+struct Loop {
+  hostsim_task task;
+  size_t queue_size;
+  std::deque<Event> q;
+  std::list<Handler> handlers;
+  // loop is in the middle of dispatch, it can't run again until it's handler returns
+  bool busy{false};
+};
+
+// thrown to unwind created task when run_until() time is reached or task deletes itself
+struct Stop {};
+struct Deleted {};
+
+int64_t _now{0};
+int64_t _stop_at{0};
+hostsim_task _main{"main", 0};
+hostsim_task _timer_task{"esp_timer", 22};
+hostsim_task _daemon{"Tmr Svc", 1};
+std::list<hostsim_task> _tasks;
+std::list<esp_timer> _timers;
+std::list<Loop> _loops;
+// harness actions and the context they run in
+struct Action {
+  std::function<void()> fn;
+  hostsim_task* ctx;
+};
+std::multimap<int64_t, Action> _actions;
+std::map<std::string, std::vector<uint8_t>> _nvs;
+// running contexts, innermost last, empty means harness
+std::vector<hostsim_task*> _stack;
+
+hostsim_task* _cur(){ return _stack.empty() ? &_main : _stack.back(); }
+
+// created task runs at the outermost level, only it could be unwound when time is up
+bool _outer_task(){ return _stack.size() == 1 && _stack.front() != &_main; }
+
+void _dispatch(Loop& l){
+  Event e = std::move(l.q.front());
+  l.q.pop_front();
+  l.busy = true;
+  _stack.push_back(&l.task);
+  void* data = e.data.empty() ? nullptr : e.data.data();
+  // same order as IDF: loop level, then base level, then base:id handlers
+  for (int level = 0; level != 3; ++level){
+    for (auto &h : l.handlers){
+      if (h.removed) continue;
+      bool match = level == 0 ? h.base == ESP_EVENT_ANY_BASE :
+                   level == 1 ? h.base == e.base && h.id == ESP_EVENT_ANY_ID :
+                                h.base == e.base && h.id == e.id;
+      if (match) h.fn(h.arg, e.base, e.id, data);
+    }
+  }
+  _stack.pop_back();
+  l.busy = false;
+  l.handlers.remove_if([](const Handler& h){ return h.removed; });
+}
+
+/**
+ * run everything that is due at current time
+ * @param blocked current context is blocked, any idle loop could run, otherwise it busy-waits and only higher priority ones run
+ */
+void _run_ready(bool blocked){
+  for (bool progress = true; progress;){
+    progress = false;
+    for (auto &t : _timers){
+      if (!t.armed || t.expiry > _now) continue;
+      t.armed = false;
+      _stack.push_back(&_timer_task);
+      t.cb(t.arg);
+      _stack.pop_back();
+      progress = true;
+    }
+    while (!_actions.empty() && _actions.begin()->first <= _now){
+      Action a = std::move(_actions.begin()->second);
+      _actions.erase(_actions.begin());
+      _stack.push_back(a.ctx);
+      a.fn();
+      _stack.pop_back();
+      progress = true;
+    }
+    // highest priority loop with pending events runs first
+    Loop* next{nullptr};
+    for (auto &l : _loops){
+      if (l.busy || l.q.empty() || (!blocked && l.task.prio <= _cur()->prio)) continue;
+      if (!next || l.task.prio > next->task.prio) next = &l;
+    }
+    if (next){
+      _dispatch(*next);
+      progress = true;
+    }
+  }
+}
+
+/**
+ * advance virtual time
+ * @param t time to advance to
+ * @param blocked see _run_ready()
+ * @param done stop early once predicate is satisfied
+ */
+void _advance(int64_t t, bool blocked, const std::function<bool()>& done = {}){
+  bool outer = _outer_task();
+  if (outer && _stop_at && t > _stop_at) t = _stop_at;
+  for (;;){
+    _run_ready(blocked);
+    if ((done && done()) || _now >= t) break;
+    int64_t next = t;
+    for (auto &tm : _timers)
+      if (tm.armed && tm.expiry < next) next = tm.expiry;
+    if (!_actions.empty() && _actions.begin()->first < next) next = _actions.begin()->first;
+    if (next > _now) _now = next;
+  }
+  if (outer && _stop_at && _now >= _stop_at && !(done && done())) throw Stop();
+}
+
+Loop* _loop(esp_event_loop_handle_t h){
+  for (auto &l : _loops)
+    if (&l == h) return &l;
+  return nullptr;
+}
+
+std::string _nvs_key(const char* ns, const char* key){ return std::string(ns) + '/' + key; }
+
+bool _nvs_has(const char* ns){
+  std::string prefix = std::string(ns) + '/';
+  auto i = _nvs.lower_bound(prefix);
+  return i != _nvs.end() && i->first.compare(0, prefix.size(), prefix) == 0;
+}
+
+// busy wait, only higher priority contexts could run meanwhile
+void _busy(int64_t us){
+  if (us > 0) _advance(_now + us, false);
+}
+
+} // namespace
+
+int64_t now(){ return _now; }
+
+void reset(){
+  _now = _stop_at = 0;
+  _tasks.clear();
+  _timers.clear();
+  _loops.clear();
+  _actions.clear();
+  _nvs.clear();
+  _stack.clear();
+  _main.notify = 0;
+}
+
+void at(int64_t t_us, std::function<void()> fn){ _actions.emplace(t_us, Action{std::move(fn), &_main}); }
+
+void timer_cb_at(int64_t t_us, std::function<void()> fn){ _actions.emplace(t_us, Action{std::move(fn), &_daemon}); }
+
+void every(int64_t t_us, int64_t period_us, std::function<bool()> fn){
+  at(t_us, [t_us, period_us, fn](){
+    if (fn()) every(t_us + period_us, period_us, fn);
+  });
+}
+
+void run_until(int64_t t_us){
+  _stop_at = t_us;
+  while (_now < t_us){
+    hostsim_task* task{nullptr};
+    for (auto &t : _tasks)
+      if (t.alive && t.fn){ task = &t; break; }
+
+    if (!task){
+      _advance(t_us, true);
+      break;
+    }
+
+    _stack.assign(1, task);
+    try {
+      task->fn(task->arg);
+      task->alive = false;
+    } catch (const Stop&){
+    } catch (const Deleted&){
+      task->alive = false;
+    }
+    _stack.clear();
+  }
+  _stop_at = 0;
+}
+
+} // namespace hostsim
+
+using namespace hostsim;
+
+// *** Arduino ***
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::print(const char* s){ return verbose ? std::fputs(s, stdout), std::strlen(s) : 0; }
+size_t HardwareSerial::print(char c){ return verbose ? std::putchar(c), 1 : 0; }
+size_t HardwareSerial::println(const char* s){ return verbose ? std::puts(s), std::strlen(s) + 1 : 0; }
+size_t HardwareSerial::printf(const char* fmt, ...){
+  if (!verbose) return 0;
+  va_list args;
+  va_start(args, fmt);
+  int n = std::vprintf(fmt, args);
+  va_end(args);
+  return n < 0 ? 0 : n;
+}
+
+void delayMicroseconds(uint32_t us){ _busy(us); }
+void delay(uint32_t ms){ _advance(_now + ms * 1000LL, true); }
+unsigned long millis(){ return _now / 1000; }
+unsigned long micros(){ return _now; }
+uint32_t analogReadMilliVolts(uint8_t pin){ return analog_mv ? analog_mv(pin) : 0; }
+
+void esp_rom_delay_us(uint32_t us){ _busy(us); }
+
+const char* esp_err_to_name(esp_err_t code){
+  switch (code){
+    case ESP_OK : return "ESP_OK";
+    case ESP_ERR_TIMEOUT : return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND : return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_INVALID_LENGTH : return "ESP_ERR_NVS_INVALID_LENGTH";
+    default : return "ESP_FAIL";
+  }
+}
+
+// *** FreeRTOS ***
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t, void* arg, UBaseType_t prio, TaskHandle_t* handle, BaseType_t){
+  hostsim_task& t = _tasks.emplace_back(hostsim_task{name, prio});
+  t.fn = fn;
+  t.arg = arg;
+  if (handle) *handle = &t;
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task){
+  if (!task) task = _cur();
+  task->alive = false;
+  if (task == _cur() && _outer_task()) throw Deleted();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(){ return _cur(); }
+
+TaskHandle_t xTimerGetTimerDaemonTaskHandle(){ return &_daemon; }
+
+TickType_t xTaskGetTickCount(){ return static_cast<TickType_t>(_now * configTICK_RATE_HZ / 1000000); }
+
+BaseType_t xTaskDelayUntil(TickType_t* prev_wake, TickType_t increment){
+  TickType_t wake = *prev_wake + increment;
+  *prev_wake = wake;
+  // deadline has passed already, task is not delayed
+  if (static_cast<int32_t>(wake - xTaskGetTickCount()) <= 0) return pdFALSE;
+  _advance(static_cast<int64_t>(wake) * 1000000 / configTICK_RATE_HZ, true);
+  return pdTRUE;
+}
+
+void vTaskDelay(TickType_t ticks){ _advance(_now + static_cast<int64_t>(ticks) * 1000000 / configTICK_RATE_HZ, true); }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks){
+  hostsim_task* self = _cur();
+  if (!self->notify && ticks){
+    int64_t t = ticks == portMAX_DELAY ? INT64_MAX : _now + static_cast<int64_t>(ticks) * 1000000 / configTICK_RATE_HZ;
+    _advance(t, true, [self](){ return self->notify != 0; });
+  }
+  uint32_t n = self->notify;
+  if (clear) self->notify = 0;
+  else if (n) --self->notify;
+  return n;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task){
+  ++task->notify;
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* task_awoken){
+  ++task->notify;
+  if (task_awoken) *task_awoken = pdTRUE;
+}
+
+// *** esp_timer ***
+
+int64_t esp_timer_get_time(){ return _now; }
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle){
+  *handle = &_timers.emplace_back(esp_timer{args->callback, args->arg});
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us){
+  if (timer->armed) return ESP_ERR_INVALID_STATE;
+  timer->expiry = _now + static_cast<int64_t>(timeout_us);
+  timer->armed = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer){
+  if (!timer->armed) return ESP_ERR_INVALID_STATE;
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer){
+  _timers.remove_if([timer](const esp_timer& t){ return &t == timer; });
+  return ESP_OK;
+}
+
+// *** esp_event ***
+
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t* args, esp_event_loop_handle_t* loop){
+  Loop& l = _loops.emplace_back();
+  l.task = hostsim_task{args->task_name, args->task_priority};
+  l.queue_size = args->queue_size;
+  *loop = &l;
+  return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t loop){
+  _loops.remove_if([loop](const Loop& l){ return &l == loop; });
+  return ESP_OK;
+}
+
+esp_err_t esp_event_post_to(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, const void* data, size_t size, TickType_t ticks){
+  Loop* l = _loop(loop);
+  if (!l) return ESP_ERR_INVALID_ARG;
+
+  if (l->q.size() >= l->queue_size){
+    hostsim_task* self = _cur();
+    if (!l->busy && &l->task != self){
+      // poster blocks, loop task gets CPU and drains the queue
+      while (l->q.size() >= l->queue_size) _dispatch(*l);
+    } else {
+      // loop can't run until poster returns, this would never end on the Iron either
+      if (ticks == portMAX_DELAY)
+        throw std::logic_error(std::string("post to a full queue of ") + l->task.name + " from " + self->name + " would block forever");
+      _advance(_now + static_cast<int64_t>(ticks) * 1000000 / configTICK_RATE_HZ, false, [l](){ return l->q.size() < l->queue_size; });
+      if (l->q.size() >= l->queue_size) return ESP_ERR_TIMEOUT;
+    }
+  }
+
+  Event e{base, id, {}};
+  if (data && size) e.data.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+  l->q.push_back(std::move(e));
+  return ESP_OK;
+}
+
+esp_err_t esp_event_isr_post_to(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, const void* data, size_t size, BaseType_t* task_awoken){
+  Loop* l = _loop(loop);
+  if (!l) return ESP_ERR_INVALID_ARG;
+  if (l->q.size() >= l->queue_size) return ESP_FAIL;
+  if (task_awoken) *task_awoken = pdTRUE;
+  return esp_event_post_to(loop, base, id, data, size, 0);
+}
+
+esp_err_t esp_event_handler_instance_register_with(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, esp_event_handler_t handler, void* arg, esp_event_handler_instance_t* instance){
+  Loop* l = _loop(loop);
+  if (!l) return ESP_ERR_INVALID_ARG;
+  Handler& h = l->handlers.emplace_back(Handler{base, id, handler, arg});
+  if (instance) *instance = &h;
+  return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_unregister_with(esp_event_loop_handle_t loop, esp_event_base_t, int32_t, esp_event_handler_instance_t instance){
+  Loop* l = _loop(loop);
+  if (!l) return ESP_ERR_INVALID_ARG;
+  for (auto &h : l->handlers)
+    if (&h == instance){
+      // handlers list is walked by dispatch, it's cleaned up afterwards
+      h.removed = true;
+      if (!l->busy) l->handlers.remove_if([](const Handler& x){ return x.removed; });
+      return ESP_OK;
+    }
+  return ESP_ERR_NOT_FOUND;
+}
+
+// *** NVS ***
+
+namespace nvs {
+
+esp_err_t NVSHandle::get_blob(const char* key, void* blob, size_t len){
+  _busy(nvs_read_us);
+  auto i = _nvs.find(_nvs_key(_ns, key));
+  if (i == _nvs.end()) return ESP_ERR_NVS_NOT_FOUND;
+  if (i->second.size() != len) return ESP_ERR_NVS_INVALID_LENGTH;
+  std::memcpy(blob, i->second.data(), len);
+  return ESP_OK;
+}
+
+esp_err_t NVSHandle::set_blob(const char* key, const void* blob, size_t len){
+  if (!_rw) return ESP_ERR_INVALID_STATE;
+  _busy(nvs_write_us);
+  _nvs[_nvs_key(_ns, key)].assign(static_cast<const uint8_t*>(blob), static_cast<const uint8_t*>(blob) + len);
+  return ESP_OK;
+}
+
+std::unique_ptr<NVSHandle> open_nvs_handle(const char* ns, nvs_open_mode_t mode, esp_err_t* err){
+  // same as IDF, namespace that has never been written to can't be opened read-only
+  esp_err_t e = mode == NVS_READONLY && !_nvs_has(ns) ? ESP_ERR_NVS_NOT_FOUND : ESP_OK;
+  if (err) *err = e;
+  return e == ESP_OK ? std::make_unique<NVSHandle>(ns, mode == NVS_READWRITE) : nullptr;
+}
+
+} // namespace nvs
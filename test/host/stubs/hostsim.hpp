@@ -0,0 +1,60 @@
+/*
+    This file is a part of ESPIron-PTS200 project
+    https://github.com/vortigont/ESPIron-PTS200
+
+    Copyright © 2024 Emil Muratov (vortigont)
+
+    ESPIron-PTS200 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+*/
+#pragma once
+#include <stdint.h>
+#include <functional>
+
+/**
+ * Host scheduler behind FreeRTOS, esp_timer, esp_event and NVS stubs
+ * time is virtual and only advances when a task blocks or busy-waits, so runs are reproducible and much faster than real time.
+ * A task created with xTaskCreatePinnedToCore() runs on the host thread inside run_until(), event loops, esp_timer callbacks
+ * and harness actions are run while it waits. Tasks are prioritized the same way as on the Iron: while a task blocks any
+ * idle loop is dispatched, while it busy-waits (ADC capture, flash access) only higher priority loops are
+ */
+namespace hostsim {
+
+// virtual time, us
+int64_t now();
+
+// drop tasks, timers, loops, actions and NVS storage, rewind time to 0
+void reset();
+
+/**
+ * @brief run harness action at specified virtual time
+ * actions are run with harness context, i.e. posts from them could wait for a full loop queue
+ */
+void at(int64_t t_us, std::function<void()> fn);
+
+/**
+ * @brief run a FreeRTOS software timer callback at specified virtual time
+ * callback runs in timer service task context, see xTimerGetTimerDaemonTaskHandle()
+ */
+void timer_cb_at(int64_t t_us, std::function<void()> fn);
+
+// run harness action every period starting at t_us, until it returns false
+void every(int64_t t_us, int64_t period_us, std::function<bool()> fn);
+
+// run created task, loops and actions until specified virtual time
+void run_until(int64_t t_us);
+
+inline void run_for(int64_t us){ run_until(now() + us); }
+
+// analogReadMilliVolts() backend
+extern std::function<uint32_t(uint8_t pin)> analog_mv;
+
+// modeled NVS access time, us, caller busy-waits for it
+extern uint32_t nvs_read_us, nvs_write_us;
+
+// print firmware Serial output to stdout
+extern bool verbose;
+
+} // namespace hostsim
@@ -0,0 +1,34 @@
+// host stub of IDF NVS C++ API, storage is kept in memory, see hostsim.hpp
+#pragma once
+#include <memory>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef enum {
+  NVS_READONLY,
+  NVS_READWRITE
+} nvs_open_mode_t;
+
+namespace nvs {
+
+class NVSHandle {
+  const char* _ns;
+  bool _rw;
+public:
+  NVSHandle(const char* ns, bool rw) : _ns(ns), _rw(rw) {}
+
+  esp_err_t get_blob(const char* key, void* blob, size_t len);
+  esp_err_t set_blob(const char* key, const void* blob, size_t len);
+
+  template <typename T>
+  esp_err_t get_item(const char* key, T& value){ return get_blob(key, &value, sizeof(T)); }
+
+  template <typename T>
+  esp_err_t set_item(const char* key, T value){ return set_blob(key, &value, sizeof(T)); }
+
+  esp_err_t commit(){ return ESP_OK; }
+};
+
+std::unique_ptr<NVSHandle> open_nvs_handle(const char* ns, nvs_open_mode_t mode, esp_err_t* err = nullptr);
+
+} // namespace nvs